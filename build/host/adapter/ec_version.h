@@ -0,0 +1,14 @@
+/* This file is generated by util/getversion.sh */
+/* Version string for use by common/version.c */
+#ifdef SHIFT_CODE_FOR_TEST
+#define CROS_EC_VERSION "host_v0.0.44-92bf715-dirty_shift"
+#else
+#define CROS_EC_VERSION "host_v0.0.44-92bf715-dirty"
+#endif
+/* Version string, truncated to 31 chars (+ terminating null = 32) */
+#define CROS_EC_VERSION32 "host_v0.0.44-92bf715-dirty"
+/* Sub-fields for use in Makefile.rules and to form build info string
+ * in common/version.c. */
+#define VERSION "host_v0.0.44-92bf715-dirty"
+#define DATE "2026-10-16 22:55:03"
+#define BUILDER "MrChromebox"
@@ -11,7 +11,7 @@
 /* Memory mapping */
 #define CONFIG_FLASH_PHYSICAL_SIZE 0x00020000
 #define CONFIG_FLASH_SIZE       CONFIG_FLASH_PHYSICAL_SIZE
-extern char __host_flash[CONFIG_FLASH_PHYSICAL_SIZE];
+extern char *__host_flash;
 
 #define CONFIG_FLASH_BASE       ((uintptr_t)__host_flash)
 #define CONFIG_FLASH_BANK_SIZE  0x1000
@@ -38,6 +38,9 @@ extern char __host_flash[CONFIG_FLASH_PHYSICAL_SIZE];
 #define CONFIG_FW_PSTATE_OFF    CONFIG_FW_RO_SIZE
 #define CONFIG_FW_PSTATE_SIZE   CONFIG_FLASH_BANK_SIZE
 
+/* Number of IRQ vectors on the emulated interrupt controller */
+#define CONFIG_IRQ_COUNT 8
+
 /* Maximum number of deferrable functions */
 #define DEFERRABLE_MAX_COUNT 8
 
@@ -9,17 +9,49 @@
 
 #include "common.h"
 #include "flash.h"
+#include "flash_timing.h"
 #include "persistence.h"
+#include "timer.h"
 #include "util.h"
 
-char __host_flash[CONFIG_FLASH_PHYSICAL_SIZE];
+/* Flash contents, mapped from persistent storage by flash_pre_init() */
+char *__host_flash;
 uint8_t __host_flash_protect[PHYSICAL_BANKS];
 
+/* Timing of flash operations; all zero for instant */
+static struct flash_timing timing;
+
+void flash_set_timing(const struct flash_timing *t)
+{
+	if (t)
+		timing = *t;
+	else
+		memset(&timing, 0, sizeof(timing));
+}
+
+/**
+ * Wait for an emulated flash operation to complete.
+ *
+ * @param us		Time the operation takes
+ */
+static void flash_wait(uint64_t us)
+{
+	unsigned n;
+
+	/* Wait at most a second at a time, to fit usleep() and udelay() */
+	for (; us; us -= n) {
+		n = MIN(us, SECOND);
+		if (timing.wait == FLASH_TIMING_SLEEP)
+			usleep(n);
+		else
+			udelay(n);
+	}
+}
+
 static int flash_check_protect(int offset, int size)
 {
 	int first_bank = offset / CONFIG_FLASH_BANK_SIZE;
-	int last_bank = DIV_ROUND_UP(offset + size + 1,
-				     CONFIG_FLASH_BANK_SIZE);
+	int last_bank = (offset + size - 1) / CONFIG_FLASH_BANK_SIZE;
 	int bank;
 
 	for (bank = first_bank; bank <= last_bank; ++bank)
@@ -28,33 +60,20 @@ static int flash_check_protect(int offset, int size)
 	return 0;
 }
 
-static void flash_set_persistent(void)
-{
-	FILE *f = get_persistent_storage("flash", "wb");
-	int sz;
-
-	ASSERT(f != NULL);
-
-	sz = fwrite(__host_flash, sizeof(__host_flash), 1, f);
-	ASSERT(sz == 1);
-
-	release_persistent_storage(f);
-}
-
 static void flash_get_persistent(void)
 {
-	FILE *f = get_persistent_storage("flash", "rb");
+	int created;
+
+	__host_flash = map_persistent_storage("flash",
+					      CONFIG_FLASH_PHYSICAL_SIZE,
+					      &created);
+	ASSERT(__host_flash != NULL);
 
-	if (f == NULL) {
+	if (created) {
 		fprintf(stderr,
 			"No flash storage found. Initializing to 0xff.\n");
-		memset(__host_flash, 0xff, sizeof(__host_flash));
-		return;
+		memset(__host_flash, 0xff, CONFIG_FLASH_PHYSICAL_SIZE);
 	}
-
-	fread(__host_flash, sizeof(__host_flash), 1, f);
-
-	release_persistent_storage(f);
 }
 
 int flash_physical_write(int offset, int size, const char *data)
@@ -65,7 +84,8 @@ int flash_physical_write(int offset, int size, const char *data)
 		return EC_ERROR_ACCESS_DENIED;
 
 	memcpy(__host_flash + offset, data, size);
-	flash_set_persistent();
+	flash_wait(DIV_ROUND_UP((uint64_t)size * timing.write_ns_per_byte,
+				1000));
 
 	return EC_SUCCESS;
 }
@@ -78,7 +98,8 @@ int flash_physical_erase(int offset, int size)
 		return EC_ERROR_ACCESS_DENIED;
 
 	memset(__host_flash + offset, 0xff, size);
-	flash_set_persistent();
+	flash_wait((uint64_t)(size / CONFIG_FLASH_ERASE_SIZE) *
+		   timing.erase_us_per_block);
 
 	return EC_SUCCESS;
 }
@@ -0,0 +1,38 @@
+/* Copyright (c) 2013 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+/* Flash timing model for emulator */
+
+#ifndef __FLASH_TIMING_H
+#define __FLASH_TIMING_H
+
+/* How the emulated flash waits for an operation to complete */
+enum flash_timing_wait {
+	/* Busy-wait, like a chip polling its flash controller */
+	FLASH_TIMING_BUSY = 0,
+	/* Sleep, letting other tasks run while flash is busy */
+	FLASH_TIMING_SLEEP,
+};
+
+struct flash_timing {
+	/* Time to program each byte, in ns */
+	uint32_t write_ns_per_byte;
+	/* Time to erase each erase block, in us */
+	uint32_t erase_us_per_block;
+	/* How to wait; see enum flash_timing_wait */
+	enum flash_timing_wait wait;
+};
+
+/**
+ * Set the timing of emulated flash operations.
+ *
+ * Flash operations complete instantly until this is called.  Sleeping must
+ * only be used once tasks are running.
+ *
+ * @param timing	New timing, or NULL to make operations instant again
+ */
+void flash_set_timing(const struct flash_timing *timing);
+
+#endif  /* __FLASH_TIMING_H */
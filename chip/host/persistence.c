@@ -5,36 +5,69 @@
 
 /* Persistence module for emulator */
 
+#include <fcntl.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #define BUF_SIZE 1024
 
+/* Maximum number of memory-mapped persistent storage regions */
+#define MAX_MAPPINGS 4
+
+static struct {
+	void *addr;
+	size_t size;
+} mappings[MAX_MAPPINGS];
+
+/*
+ * If set, persistent storage is kept in this directory instead of next to
+ * the executable, so that concurrent runs of the same test don't collide.
+ */
+#define PERSIST_DIR_ENV "EMU_PERSIST_DIR"
+
 static void get_storage_path(char *out)
 {
 	char buf[BUF_SIZE];
+	const char *dir = getenv(PERSIST_DIR_ENV);
+	const char *name;
 	int sz;
 
-	sz = readlink("/proc/self/exe", buf, BUF_SIZE);
+	sz = readlink("/proc/self/exe", buf, BUF_SIZE - 1);
 	buf[sz] = '\0';
-	if (snprintf(out, BUF_SIZE, "%s_persist", buf) >= BUF_SIZE)
+
+	if (dir && *dir) {
+		name = strrchr(buf, '/');
+		name = name ? name + 1 : buf;
+		sz = snprintf(out, BUF_SIZE, "%s/%s_persist", dir, name);
+	} else {
+		sz = snprintf(out, BUF_SIZE, "%s_persist", buf);
+	}
+	if (sz >= BUF_SIZE)
 		out[BUF_SIZE - 1] = '\0';
 }
 
-FILE *get_persistent_storage(const char *tag, const char *mode)
+static void get_tag_path(const char *tag, char *out)
 {
 	char buf[BUF_SIZE];
-	char path[BUF_SIZE];
 
 	/*
 	 * The persistent storage with tag 'foo' for test 'bar' would
 	 * be named 'bar_persist_foo'
 	 */
 	get_storage_path(buf);
-	if (snprintf(path, BUF_SIZE, "%s_%s", buf, tag) >= BUF_SIZE)
-		path[BUF_SIZE - 1] = '\0';
+	if (snprintf(out, BUF_SIZE, "%s_%s", buf, tag) >= BUF_SIZE)
+		out[BUF_SIZE - 1] = '\0';
+}
 
+FILE *get_persistent_storage(const char *tag, const char *mode)
+{
+	char path[BUF_SIZE];
+
+	get_tag_path(tag, path);
 	return fopen(path, mode);
 }
 
@@ -45,12 +78,58 @@ void release_persistent_storage(FILE *ps)
 
 void remove_persistent_storage(const char *tag)
 {
-	char buf[BUF_SIZE];
 	char path[BUF_SIZE];
 
-	get_storage_path(buf);
-	if (snprintf(path, BUF_SIZE, "%s_%s", buf, tag) >= BUF_SIZE)
-		path[BUF_SIZE - 1] = '\0';
-
+	get_tag_path(tag, path);
 	unlink(path);
 }
+
+void *map_persistent_storage(const char *tag, size_t size, int *created)
+{
+	char path[BUF_SIZE];
+	struct stat st;
+	void *addr;
+	int fd;
+	int i;
+
+	for (i = 0; i < MAX_MAPPINGS; ++i)
+		if (mappings[i].addr == NULL)
+			break;
+	if (i == MAX_MAPPINGS)
+		return NULL;
+
+	get_tag_path(tag, path);
+	fd = open(path, O_RDWR | O_CREAT, 0644);
+	if (fd < 0)
+		return NULL;
+
+	if (fstat(fd, &st) < 0) {
+		close(fd);
+		return NULL;
+	}
+
+	/* Storage which is missing or short is sized (zero-filled) to fit */
+	*created = (st.st_size != size);
+	if (*created && ftruncate(fd, size) < 0) {
+		close(fd);
+		return NULL;
+	}
+
+	addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED)
+		return NULL;
+
+	mappings[i].addr = addr;
+	mappings[i].size = size;
+	return addr;
+}
+
+void sync_persistent_storage(void)
+{
+	int i;
+
+	for (i = 0; i < MAX_MAPPINGS; ++i)
+		if (mappings[i].addr)
+			msync(mappings[i].addr, mappings[i].size, MS_SYNC);
+}
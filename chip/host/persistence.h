@@ -16,4 +16,24 @@ void release_persistent_storage(FILE *ps);
 
 void remove_persistent_storage(const char *tag);
 
+/**
+ * Map persistent storage into memory.
+ *
+ * The storage file is created or resized to fit if needed.  The mapping is
+ * shared with the file, so stores only dirty the pages they touch and
+ * survive an emulated reboot.
+ *
+ * @param tag		Storage tag
+ * @param size		Size of the mapping in bytes
+ * @param created	Set non-zero if the storage was (re)created and is
+ *			zero-filled, zero if it holds previous contents
+ * @return The mapped address, or NULL if error.
+ */
+void *map_persistent_storage(const char *tag, size_t size, int *created);
+
+/**
+ * Flush all memory-mapped persistent storage to its backing files.
+ */
+void sync_persistent_storage(void);
+
 #endif /* _PERSISTENCE_H */
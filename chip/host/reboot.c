@@ -9,10 +9,13 @@
 #include <unistd.h>
 
 #include "host_test.h"
+#include "persistence.h"
 #include "reboot.h"
 
 void emulator_reboot(void)
 {
 	char *argv[] = {strdup(__get_prog_name()), NULL};
+
+	sync_persistent_storage();
 	execv(__get_prog_name(), argv);
 }
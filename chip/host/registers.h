@@ -9,3 +9,11 @@
  * There is no register for emulator, but this file exists to prevent
  * compilation failure if any file includes registers.h
  */
+
+#ifndef __CROS_EC_REGISTERS_H
+#define __CROS_EC_REGISTERS_H
+
+/* Emulated IRQ numbers */
+#define EMU_IRQ_UART 0
+
+#endif /* __CROS_EC_REGISTERS_H */
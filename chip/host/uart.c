@@ -12,18 +12,23 @@
 
 #include "common.h"
 #include "queue.h"
+#include "registers.h"
 #include "task.h"
 #include "uart.h"
 #include "util.h"
 
 static int stopped;
-static int int_disabled;
 static int init_done;
 
 static pthread_t input_thread;
 
 #define INPUT_BUFFER_SIZE 16
-/* TODO: Guard these data with mutex lock when we have interrupt support. */
+/*
+ * Input is received on the stdin monitor thread and consumed by the UART
+ * interrupt on the emulator thread, so guard the cached input with a lock.
+ */
+static pthread_mutex_t input_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t input_read_cond = PTHREAD_COND_INITIALIZER;
 static int char_available;
 static char cached_char_buf[INPUT_BUFFER_SIZE];
 static struct queue cached_char = {
@@ -34,12 +39,7 @@ static struct queue cached_char = {
 
 static void trigger_interrupt(void)
 {
-	/*
-	 * TODO: Check global interrupt status when we have
-	 * interrupt support.
-	 */
-	if (!int_disabled)
-		uart_process();
+	task_trigger_irq(EMU_IRQ_UART);
 }
 
 int uart_init_done(void)
@@ -75,7 +75,12 @@ int uart_tx_ready(void)
 
 int uart_rx_available(void)
 {
-	return char_available;
+	int ret;
+
+	pthread_mutex_lock(&input_lock);
+	ret = char_available;
+	pthread_mutex_unlock(&input_lock);
+	return ret;
 }
 
 void uart_write_char(char c)
@@ -87,21 +92,31 @@ void uart_write_char(char c)
 int uart_read_char(void)
 {
 	char ret;
+
+	pthread_mutex_lock(&input_lock);
 	queue_remove_unit(&cached_char, &ret);
 	--char_available;
+	pthread_cond_signal(&input_read_cond);
+	pthread_mutex_unlock(&input_lock);
 	return ret;
 }
 
 void uart_disable_interrupt(void)
 {
-	int_disabled = 1;
+	task_disable_irq(EMU_IRQ_UART);
 }
 
 void uart_enable_interrupt(void)
 {
-	int_disabled = 0;
+	task_enable_irq(EMU_IRQ_UART);
 }
 
+static void uart_interrupt(void)
+{
+	uart_process();
+}
+DECLARE_IRQ(EMU_IRQ_UART, uart_interrupt, 2);
+
 void uart_inject_char(char *s, int sz)
 {
 	int i;
@@ -109,10 +124,14 @@ void uart_inject_char(char *s, int sz)
 
 	for (i = 0; i < sz; i += INPUT_BUFFER_SIZE - 1) {
 		num_char = MIN(INPUT_BUFFER_SIZE - 1, sz - i);
-		if (!queue_has_space(&cached_char, num_char))
+		pthread_mutex_lock(&input_lock);
+		if (!queue_has_space(&cached_char, num_char)) {
+			pthread_mutex_unlock(&input_lock);
 			return;
+		}
 		queue_add_units(&cached_char, s + i, num_char);
-		char_available = num_char;
+		char_available += num_char;
+		pthread_mutex_unlock(&input_lock);
 		trigger_interrupt();
 	}
 }
@@ -133,16 +152,18 @@ void *uart_monitor_stdin(void *d)
 	while (1) {
 		tcsetattr(0, TCSANOW, &new_settings);
 		rv = read(0, buf, INPUT_BUFFER_SIZE);
-		if (queue_has_space(&cached_char, rv)) {
-			queue_add_units(&cached_char, buf, rv);
-			char_available = rv;
-		}
 		tcsetattr(0, TCSANOW, &org_settings);
-		/*
-		 * TODO: Trigger emulated interrupt when we have
-		 * interrupt support. Also, we will need a condition
-		 * variable to indicate the character has been read.
-		 */
+		if (rv <= 0)
+			break;
+
+		/* Wait for the UART interrupt to drain enough input */
+		pthread_mutex_lock(&input_lock);
+		while (!queue_has_space(&cached_char, rv))
+			pthread_cond_wait(&input_read_cond, &input_lock);
+		queue_add_units(&cached_char, buf, rv);
+		char_available += rv;
+		pthread_mutex_unlock(&input_lock);
+
 		trigger_interrupt();
 	}
 
@@ -124,6 +124,9 @@
 #define CONFIG_PECI
 #define CONFIG_SWITCH
 
+/* Defer formatting console output from the LPC interrupt (port 80) */
+#define CONFIG_CONSOLE_DEFERRED 128
+
 /* Compile for running from RAM instead of flash */
 /* #define COMPILE_FOR_RAM */
 
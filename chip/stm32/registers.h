@@ -103,6 +103,7 @@
 
 #define STM32_USART_SR(n)          STM32_USART_REG(n, 0x00)
 #define STM32_USART_SR_RXNE		(1 << 5)
+#define STM32_USART_SR_TC		(1 << 6)
 #define STM32_USART_SR_TXE		(1 << 7)
 #define STM32_USART_DR(n)          STM32_USART_REG(n, 0x04)
 #define STM32_USART_BRR(n)         STM32_USART_REG(n, 0x08)
@@ -110,11 +111,13 @@
 #define STM32_USART_CR1_RE		(1 << 2)
 #define STM32_USART_CR1_TE		(1 << 3)
 #define STM32_USART_CR1_RXNEIE		(1 << 5)
+#define STM32_USART_CR1_TCIE		(1 << 6)
 #define STM32_USART_CR1_TXEIE		(1 << 7)
 #define STM32_USART_CR1_UE		(1 << 13)
 #define STM32_USART_CR1_OVER8		(1 << 15) /* STM32L only */
 #define STM32_USART_CR2(n)         STM32_USART_REG(n, 0x10)
 #define STM32_USART_CR3(n)         STM32_USART_REG(n, 0x14)
+#define STM32_USART_CR3_DMAT		(1 << 7)
 #define STM32_USART_CR3_ONEBIT		(1 << 11) /* STM32L only */
 #define STM32_USART_GTPR(n)        STM32_USART_REG(n, 0x18)
 
@@ -653,6 +656,8 @@ enum dma_channel {
 	STM32_DMAC_USART1_RX = STM32_DMAC_CH5,
 	STM32_DMAC_I2C1_TX = STM32_DMAC_CH6,
 	STM32_DMAC_I2C1_RX = STM32_DMAC_CH7,
+	STM32_DMAC_USART2_TX = STM32_DMAC_CH7,
+	STM32_DMAC_USART3_TX = STM32_DMAC_CH2,
 
 	/* Only DMA1 (with 7 channels) is present on STM32F100 and STM32L151x */
 	STM32_DMAC_COUNT = 7,
@@ -7,6 +7,7 @@
 
 #include "common.h"
 #include "clock.h"
+#include "dma.h"
 #include "gpio.h"
 #include "hooks.h"
 #include "registers.h"
@@ -21,6 +22,19 @@
 static int init_done;    /* Initialization done? */
 static int should_stop;  /* Last TX control action */
 
+#ifdef CONFIG_UART_TX_DMA
+/* Transmit interrupts when the DMA transfer has been sent */
+#define CR1_TX_INT STM32_USART_CR1_TCIE
+
+static const struct dma_option dma_tx_option = {
+	CONCAT3(STM32_DMAC_USART, UARTN, _TX), (void *)&STM32_USART_DR(UARTN),
+	STM32_DMA_CCR_MSIZE_8_BIT | STM32_DMA_CCR_PSIZE_8_BIT
+};
+#else
+/* Transmit interrupts when there is room for the next character */
+#define CR1_TX_INT STM32_USART_CR1_TXEIE
+#endif
+
 int uart_init_done(void)
 {
 	return init_done;
@@ -29,21 +43,21 @@ int uart_init_done(void)
 void uart_tx_start(void)
 {
 	disable_sleep(SLEEP_MASK_UART);
-	STM32_USART_CR1(UARTN) |= STM32_USART_CR1_TXEIE;
+	STM32_USART_CR1(UARTN) |= CR1_TX_INT;
 	should_stop = 0;
 	task_trigger_irq(STM32_IRQ_USART(UARTN));
 }
 
 void uart_tx_stop(void)
 {
-	STM32_USART_CR1(UARTN) &= ~STM32_USART_CR1_TXEIE;
+	STM32_USART_CR1(UARTN) &= ~CR1_TX_INT;
 	should_stop = 1;
 	enable_sleep(SLEEP_MASK_UART);
 }
 
 int uart_tx_stopped(void)
 {
-	return !(STM32_USART_CR1(UARTN) & STM32_USART_CR1_TXEIE);
+	return !(STM32_USART_CR1(UARTN) & CR1_TX_INT);
 }
 
 void uart_tx_flush(void)
@@ -57,6 +71,28 @@ int uart_tx_ready(void)
 	return STM32_USART_SR(UARTN) & STM32_USART_SR_TXE;
 }
 
+#ifdef CONFIG_UART_TX_DMA
+int uart_tx_dma_ready(void)
+{
+	return STM32_USART_SR(UARTN) & STM32_USART_SR_TC;
+}
+
+void uart_tx_dma_start(const char *src, int len)
+{
+	dma_prepare_tx(&dma_tx_option, len, src);
+
+	/*
+	 * Clear TC so it's only set again once this transfer is sent.  SR bits
+	 * are cleared by writing 0 and unaffected by writing 1, so write the
+	 * mask rather than read-modify-write, which could clear RXNE.
+	 */
+	STM32_USART_SR(UARTN) = ~STM32_USART_SR_TC;
+	STM32_USART_CR1(UARTN) |= STM32_USART_CR1_TCIE;
+
+	dma_go(dma_get_channel(dma_tx_option.channel));
+}
+#endif
+
 int uart_rx_available(void)
 {
 	return STM32_USART_SR(UARTN) & STM32_USART_SR_RXNE;
@@ -90,21 +126,32 @@ void uart_enable_interrupt(void)
 /* Interrupt handler for console USART */
 static void uart_interrupt(void)
 {
+#ifdef CONFIG_UART_TX_DMA
+	/*
+	 * Disable the transfer complete interrupt once the transfer is done,
+	 * since TC stays set until the next transfer starts.
+	 */
+	if (STM32_USART_SR(UARTN) & STM32_USART_SR_TC)
+		STM32_USART_CR1(UARTN) &= ~STM32_USART_CR1_TCIE;
+#else
 	/*
 	 * Disable the TX empty interrupt before filling the TX buffer since it
 	 * needs an actual write to DR to be cleared.
 	 */
 	STM32_USART_CR1(UARTN) &= ~STM32_USART_CR1_TXEIE;
+#endif
 
 	/* Read input FIFO until empty, then fill output FIFO */
 	uart_process();
 
+#ifndef CONFIG_UART_TX_DMA
 	/*
 	 * Re-enable TX empty interrupt only if it was not disabled by
 	 * uart_process.
 	 */
 	if (!should_stop)
 		STM32_USART_CR1(UARTN) |= STM32_USART_CR1_TXEIE;
+#endif
 }
 DECLARE_IRQ(STM32_IRQ_USART(UARTN), uart_interrupt, 2);
 
@@ -148,6 +195,14 @@ void uart_init(void)
 	STM32_RCC_APB1ENR |= STM32_RCC_PB1_USART ## UARTN;
 #endif
 
+#ifdef CONFIG_UART_TX_DMA
+	/*
+	 * Enable DMA1 now; dma_init() doesn't run until HOOK_INIT, long after
+	 * the first console output.
+	 */
+	STM32_RCC_AHBENR |= STM32_RCC_HB_DMA1;
+#endif
+
 	/* Configure GPIOs */
 	gpio_config_module(MODULE_UART, 1);
 
@@ -165,6 +220,11 @@ void uart_init(void)
 	/* DMA disabled, special modes disabled, error interrupt disabled */
 	STM32_USART_CR3(UARTN) = 0x0000;
 
+#ifdef CONFIG_UART_TX_DMA
+	/* Transmit from DMA */
+	STM32_USART_CR3(UARTN) |= STM32_USART_CR3_DMAT;
+#endif
+
 #ifdef CHIP_FAMILY_stm32l
 	/* Use single-bit sampling */
 	STM32_USART_CR3(UARTN) |= STM32_USART_CR3_ONEBIT;
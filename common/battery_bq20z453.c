@@ -14,25 +14,16 @@
 int battery_command_cut_off(struct host_cmd_handler_args *args)
 {
 	/*
-	 * TODO: Since this is a host command, the i2c bus is claimed by host.
-	 *       Thus, we would send back the response in advanced so that
-	 *       the host can release the bus and then EC can send command to
-	 *       battery.
-	 *
-	 *       Refactoring this via task is a way. However, it is wasteful.
-	 *       Need a light-weight solution.
+	 * Since this is a host command, the i2c bus is claimed by the host.
+	 * Send an interim response so the host releases the bus, then send
+	 * the command to the battery.  The host can fetch the result later.
 	 */
-	args->result = EC_RES_SUCCESS;
-	host_send_response(args);
+	host_command_in_progress(args);
 
-	/* This function would try to claim i2c and then send to battery. */
-	sb_write(SB_MANUFACTURER_ACCESS, PARAM_CUT_OFF);
+	if (sb_write(SB_MANUFACTURER_ACCESS, PARAM_CUT_OFF))
+		return EC_RES_ERROR;
 
 	return EC_RES_SUCCESS;
-	/*
-	 * Not sure if there is a side-effect since this could send result
-	 * back to host TWICE.
-	 */
 }
 DECLARE_HOST_COMMAND(EC_CMD_BATTERY_CUT_OFF, battery_command_cut_off,
 		     EC_VER_MASK(0));
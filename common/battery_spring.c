@@ -18,6 +18,9 @@ int battery_command_cut_off(struct host_cmd_handler_args *args)
 	int rv;
 	uint8_t buf[3];
 
+	/* Release the host while we talk to the battery */
+	host_command_in_progress(args);
+
 	buf[0] = SB_MANUFACTURER_ACCESS & 0xff;
 	buf[1] = PARAM_CUT_OFF_LOW;
 	buf[2] = PARAM_CUT_OFF_HIGH;
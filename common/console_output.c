@@ -6,6 +6,11 @@
 /* Console output module for Chrome EC */
 
 #include "console.h"
+#include "hooks.h"
+#include "host_command.h"
+#include "printf.h"
+#include "task.h"
+#include "timer.h"
 #include "uart.h"
 #include "util.h"
 
@@ -43,16 +48,174 @@ static const char *channel_names[CC_CHANNEL_COUNT] = {
 	"vboot",
 };
 
+/*****************************************************************************/
+/* Channel statistics and rate limiting */
+
+#ifdef CONFIG_CONSOLE_RATE_LIMIT
+/* Time for a channel to earn one byte of output, in us */
+#define RATE_BYTE_US (SECOND / CONFIG_CONSOLE_RATE_LIMIT)
+#endif
+
+/*
+ * Output statistics for each channel.  Not updated atomically, so counts
+ * may be slightly off if an interrupt outputs on the same channel as the
+ * code it interrupted.
+ */
+struct channel_stats {
+	uint32_t bytes;		/* Bytes output */
+	uint32_t dropped_full;	/* Bytes dropped because UART buffer was full */
+	uint32_t dropped_rate;	/* Bytes dropped by rate limiting */
+#ifdef CONFIG_CONSOLE_RATE_LIMIT
+	int spent;		/* Bytes of the burst used up */
+	uint32_t refill_time;	/* Time up to which spent bytes are refilled */
+#endif
+};
+static struct channel_stats stats[CC_CHANNEL_COUNT];
+
+/**
+ * vfnprintf() callback which counts output size, including carriage returns
+ * added before newlines.
+ *
+ * @param context	Pointer to count to increment.
+ * @param c		Character being output.
+ * @return 0.
+ */
+static int count_char(void *context, int c)
+{
+	*(int *)context += (c == '\n') ? 2 : 1;
+	return 0;
+}
+
+/**
+ * Estimate the size of output which is dropped.
+ *
+ * Formatting output just to count what was dropped costs as much as printing
+ * it, so formatted output is counted as the size of its format string.
+ *
+ * @param str		String or format string being output.
+ * @return number of bytes, including carriage returns added before newlines.
+ */
+static int output_size(const char *str)
+{
+	int size = 0;
+
+	for (; *str; str++)
+		count_char(&size, *str);
+	return size;
+}
+
+/**
+ * Check whether a channel may output now.
+ *
+ * @param channel	Output channel
+ * @return non-zero if the channel is within its rate limit.
+ */
+static int channel_tx_allowed(enum console_channel channel)
+{
+#ifdef CONFIG_CONSOLE_RATE_LIMIT
+	struct channel_stats *s = stats + channel;
+	uint32_t now;
+	int earned, rv;
+
+	/* Interactive output is never limited */
+	if (channel == CC_COMMAND)
+		return 1;
+
+	/*
+	 * Refill the bucket for the time since it was last refilled.  Output
+	 * may come from tasks and interrupts, so do it with interrupts
+	 * disabled.
+	 */
+	interrupt_disable();
+	now = get_time().le.lo;
+	earned = (now - s->refill_time) / RATE_BYTE_US;
+	if (earned >= s->spent) {
+		s->spent = 0;
+		s->refill_time = now;
+	} else {
+		s->spent -= earned;
+		s->refill_time += earned * RATE_BYTE_US;
+	}
+	rv = s->spent < CONFIG_CONSOLE_RATE_BURST;
+	interrupt_enable();
+
+	return rv;
+#else
+	return 1;
+#endif
+}
+
+/**
+ * Count output on a channel.
+ *
+ * @param channel	Output channel
+ * @param written	Bytes written to UART buffer before the output, from
+ *			uart_get_tx_stats().
+ * @param dropped	Bytes dropped by UART buffer before the output, from
+ *			uart_get_tx_stats().
+ */
+static void channel_tx_done(enum console_channel channel, uint32_t written,
+			    uint32_t dropped)
+{
+	struct channel_stats *s = stats + channel;
+	uint32_t w, d;
+
+	uart_get_tx_stats(&w, &d);
+	s->bytes += w - written;
+	s->dropped_full += d - dropped;
+#ifdef CONFIG_CONSOLE_RATE_LIMIT
+	interrupt_disable();
+	s->spent += w - written;
+	interrupt_enable();
+#endif
+}
+
 /*****************************************************************************/
 /* Channel-based console output */
 
 int cputs(enum console_channel channel, const char *outstr)
 {
+	uint32_t written, dropped;
+	int rv;
+
 	/* Filter out inactive channels */
 	if (!(CC_MASK(channel) & channel_mask))
 		return EC_SUCCESS;
 
-	return uart_puts(outstr);
+	if (!channel_tx_allowed(channel)) {
+		stats[channel].dropped_rate += output_size(outstr);
+		return EC_ERROR_OVERFLOW;
+	}
+
+	uart_get_tx_stats(&written, &dropped);
+	rv = uart_puts(outstr);
+	channel_tx_done(channel, written, dropped);
+	return rv;
+}
+
+/**
+ * Print formatted output on a channel, if it is within its rate limit.
+ *
+ * @param channel	Output channel
+ * @param format	Format string
+ * @param args		Parameters
+ * @return non-zero if output was truncated or dropped.
+ */
+static int channel_vprintf(enum console_channel channel, const char *format,
+			   va_list args)
+{
+	uint32_t written, dropped;
+	int rv;
+
+	if (!channel_tx_allowed(channel)) {
+		stats[channel].dropped_rate += output_size(format);
+		return EC_ERROR_OVERFLOW;
+	}
+
+	uart_get_tx_stats(&written, &dropped);
+	rv = uart_vprintf(format, args);
+	channel_tx_done(channel, written, dropped);
+	return rv;
 }
 
 int cprintf(enum console_channel channel, const char *format, ...)
@@ -65,13 +228,145 @@ int cprintf(enum console_channel channel, const char *format, ...)
 		return EC_SUCCESS;
 
 	va_start(args, format);
-	rv = uart_vprintf(format, args);
+	rv = channel_vprintf(channel, format, args);
 	va_end(args);
 	return rv;
 }
 
+#ifdef CONFIG_CONSOLE_DEFERRED
+/* Maximum number of packed parameter words in a deferred record */
+#define DEFERRED_MAX_ARGS 8
+
+#define DEFERRED_NEXT(i) (((i) + 1) & (CONFIG_CONSOLE_DEFERRED - 1))
+
+/* Shift for the channel in the second word of a deferred record */
+#define DEFERRED_CHANNEL_SHIFT 8
+
+/*
+ * Deferred output records.  Each is the format string, the channel and the
+ * number of packed parameter words, then the parameters.  Written from any
+ * context with interrupts disabled; read by the hook task.
+ */
+static uintptr_t deferred_buf[CONFIG_CONSOLE_DEFERRED];
+static int deferred_head;
+static int deferred_tail;
+static int deferred_dropped;
+/* Estimated bytes dropped per channel because the buffer was full */
+static int deferred_dropped_size[CC_CHANNEL_COUNT];
+
+/**
+ * Format deferred output records into the UART buffer.
+ */
+static void deferred_print(void)
+{
+	uintptr_t args[DEFERRED_MAX_ARGS];
+	uint32_t written, dropped_full;
+	enum console_channel channel;
+	const char *format;
+	int dropped_size[CC_CHANNEL_COUNT];
+	int dropped;
+	int n, i;
+
+	while (1) {
+		interrupt_disable();
+		if (deferred_tail == deferred_head) {
+			dropped = deferred_dropped;
+			deferred_dropped = 0;
+			memcpy(dropped_size, deferred_dropped_size,
+			       sizeof(dropped_size));
+			memset(deferred_dropped_size, 0,
+			       sizeof(deferred_dropped_size));
+			interrupt_enable();
+			break;
+		}
+
+		format = (const char *)deferred_buf[deferred_tail];
+		deferred_tail = DEFERRED_NEXT(deferred_tail);
+		n = deferred_buf[deferred_tail];
+		channel = n >> DEFERRED_CHANNEL_SHIFT;
+		n &= (1 << DEFERRED_CHANNEL_SHIFT) - 1;
+		deferred_tail = DEFERRED_NEXT(deferred_tail);
+		for (i = 0; i < n; i++) {
+			args[i] = deferred_buf[deferred_tail];
+			deferred_tail = DEFERRED_NEXT(deferred_tail);
+		}
+		interrupt_enable();
+
+		uart_get_tx_stats(&written, &dropped_full);
+		uart_printf_packed(format, args);
+		channel_tx_done(channel, written, dropped_full);
+	}
+
+	if (dropped) {
+		for (i = 0; i < CC_CHANNEL_COUNT; i++)
+			stats[i].dropped_full += dropped_size[i];
+		uart_printf("\n[%d deferred console lines dropped]\n", dropped);
+	}
+}
+DECLARE_DEFERRED(deferred_print);
+
+int cprintf_deferred(enum console_channel channel, const char *format, ...)
+{
+	uintptr_t args[DEFERRED_MAX_ARGS];
+	va_list va;
+	int rv = EC_SUCCESS;
+	int n, i;
+
+	/* Filter out inactive channels */
+	if (!(CC_MASK(channel) & channel_mask))
+		return EC_SUCCESS;
+
+	va_start(va, format);
+	n = printf_pack_args(args, ARRAY_SIZE(args), format, va);
+	va_end(va);
+
+	if (n < 0) {
+		/* Too many parameters to save; print now instead */
+		va_start(va, format);
+		rv = channel_vprintf(channel, format, va);
+		va_end(va);
+		return rv;
+	}
+
+	if (!channel_tx_allowed(channel)) {
+		stats[channel].dropped_rate += output_size(format);
+		return EC_ERROR_OVERFLOW;
+	}
+
+	interrupt_disable();
+	if (((deferred_tail - deferred_head - 1) &
+	     (CONFIG_CONSOLE_DEFERRED - 1)) < n + 2) {
+		/* Counted in the channel stats by deferred_print() */
+		deferred_dropped++;
+		deferred_dropped_size[channel] += output_size(format);
+		rv = EC_ERROR_OVERFLOW;
+	} else {
+		deferred_buf[deferred_head] = (uintptr_t)format;
+		deferred_head = DEFERRED_NEXT(deferred_head);
+		deferred_buf[deferred_head] =
+			n | (channel << DEFERRED_CHANNEL_SHIFT);
+		deferred_head = DEFERRED_NEXT(deferred_head);
+		for (i = 0; i < n; i++) {
+			deferred_buf[deferred_head] = args[i];
+			deferred_head = DEFERRED_NEXT(deferred_head);
+		}
+	}
+	interrupt_enable();
+
+	if (rv == EC_SUCCESS)
+		hook_call_deferred(deferred_print, 0);
+
+	return rv;
+}
+#endif
+
 void cflush(void)
 {
+#ifdef CONFIG_CONSOLE_DEFERRED
+	/* Deferred output comes first */
+	if (!in_interrupt_context())
+		deferred_print();
+#endif
 	uart_flush_output();
 }
 
@@ -123,3 +418,46 @@ DECLARE_CONSOLE_COMMAND(chan, command_ch,
 			"[ save | restore | <mask> ]",
 			"Save, restore, get or set console channel mask",
 			NULL);
+
+/* Print channel output statistics */
+static int command_chstats(int argc, char **argv)
+{
+	int i;
+
+	ccputs(" # Channel         Bytes  Dropped(full)  Dropped(rate)\n");
+	for (i = 0; i < CC_CHANNEL_COUNT; i++) {
+		ccprintf("%2d %-10s %10u     %10u     %10u\n",
+			 i, channel_names[i], stats[i].bytes,
+			 stats[i].dropped_full, stats[i].dropped_rate);
+		cflush();
+	}
+	return EC_SUCCESS;
+}
+DECLARE_CONSOLE_COMMAND(chstats, command_chstats,
+			NULL,
+			"Print console channel output statistics",
+			NULL);
+
+/*****************************************************************************/
+/* Host commands */
+
+static int host_command_channel_stats(struct host_cmd_handler_args *args)
+{
+	const struct ec_params_console_channel_stats *p = args->params;
+	struct ec_response_console_channel_stats *r = args->response;
+	int channel = p->channel;
+
+	if (channel >= CC_CHANNEL_COUNT)
+		return EC_RES_INVALID_PARAM;
+
+	strzcpy(r->name, channel_names[channel], sizeof(r->name));
+	r->bytes = stats[channel].bytes;
+	r->dropped_full = stats[channel].dropped_full;
+	r->dropped_rate = stats[channel].dropped_rate;
+	args->response_size = sizeof(*r);
+
+	return EC_RES_SUCCESS;
+}
+DECLARE_HOST_COMMAND(EC_CMD_CONSOLE_CHANNEL_STATS,
+		     host_command_channel_stats,
+		     EC_VER_MASK(0));
@@ -7,11 +7,15 @@
 
 #include "common.h"
 #include "console.h"
+#include "ec_crc32.h"
 #include "flash.h"
 #include "gpio.h"
+#include "hooks.h"
 #include "host_command.h"
 #include "shared_mem.h"
 #include "system.h"
+#include "task.h"
+#include "timer.h"
 #include "util.h"
 #include "vboot_hash.h"
 
@@ -36,6 +40,71 @@ struct persist_state {
 /* Protect persist state and RO firmware at boot */
 #define PERSIST_FLAG_PROTECT_RO 0x02
 
+/* Number of erase blocks in usable flash, and words of bitmap to cover them */
+#define ERASE_BLOCKS (CONFIG_FLASH_SIZE / CONFIG_FLASH_ERASE_SIZE)
+#define ERASE_MAP_WORDS ((ERASE_BLOCKS + 31) / 32)
+
+/*
+ * Cached erase state of each block.  Bits in erase_known are set for blocks
+ * whose state is known; for those, bits in erase_map are set if the block is
+ * erased.  Everything is unknown at boot, and blocks are scanned on demand.
+ */
+static uint32_t erase_known[ERASE_MAP_WORDS];
+static uint32_t erase_map[ERASE_MAP_WORDS];
+
+#ifdef CONFIG_FLASH_STATS
+/* Wear record follows the persistent state in the pstate bank */
+#define WRITE_ALIGN(size) (((size) + CONFIG_FLASH_WRITE_SIZE - 1) & \
+			   ~(CONFIG_FLASH_WRITE_SIZE - 1))
+#define WEAR_OFFSET (PSTATE_OFFSET + WRITE_ALIGN(sizeof(struct persist_state)))
+#define WEAR_WORDS (WRITE_ALIGN((1 + PHYSICAL_BANKS) * 4) / 4)
+#define WEAR_MAGIC 0x52414557  /* "WEAR" */
+
+/*
+ * Wear records are appended to the erased space after the persistent state,
+ * so saving one doesn't need an erase.  The last record is the current one.
+ */
+#define WEAR_SLOTS ((PSTATE_OFFSET + PSTATE_SIZE - WEAR_OFFSET) / sizeof(wear))
+#define WEAR_SLOT_OFFSET(n) (WEAR_OFFSET + (n) * sizeof(wear))
+
+/* Delay after the last erase before the wear record is saved */
+#define WEAR_SAVE_DELAY_US (2 * SECOND)
+
+/*
+ * Wear record: WEAR_MAGIC, then the number of erase blocks erased in each
+ * physical bank.  Loaded from flash on first use.
+ */
+static uint32_t wear[WEAR_WORDS];
+static int wear_loaded;
+static int wear_dirty;
+static int wear_slot;  /* Next free wear record slot */
+
+BUILD_ASSERT(WEAR_SLOTS >= 1);
+
+/* Latency of flash operations */
+struct flash_op_stats {
+	uint32_t max_us;
+	uint32_t hist[EC_FLASH_STATS_BUCKETS];
+};
+static struct flash_op_stats write_stats;
+static struct flash_op_stats erase_stats;
+#endif
+
+#ifdef CONFIG_FLASH_WRITE_COMBINE
+/* Delay before buffered writes are flushed to flash if nothing else does */
+#define WRITE_COMBINE_FLUSH_DELAY_US (10 * MSEC)
+
+/*
+ * Write-combining buffer.  Holds data for the flash range [wc_offset,
+ * wc_offset + wc_size), which never crosses a CONFIG_FLASH_WRITE_IDEAL_SIZE
+ * boundary, so it can be programmed in a single cycle.
+ */
+static uint32_t wc_buf[CONFIG_FLASH_WRITE_IDEAL_SIZE / sizeof(uint32_t)];
+static int wc_offset;
+static int wc_size;
+static struct mutex wc_lock;
+#endif
+
 /**
  * Get the physical memory address of a flash offset
  *
@@ -69,23 +138,143 @@ static void flash_read_pstate(struct persist_state *pstate)
 }
 
 /**
- * Write persistent state from pstate, erasing if necessary.
+ * Update the cached erase state of the blocks in a range of flash.
+ *
+ * @param offset	Flash offset of range
+ * @param size		Size of range in bytes
+ * @param known		Non-zero if the state of the blocks is known
+ * @param erased	If known, non-zero if the blocks are erased
+ */
+static void erase_map_update(int offset, int size, int known, int erased)
+{
+	int block = offset / CONFIG_FLASH_ERASE_SIZE;
+	int end = (offset + size + CONFIG_FLASH_ERASE_SIZE - 1) /
+		CONFIG_FLASH_ERASE_SIZE;
+	uint32_t bit;
+
+	for (end = MIN(end, ERASE_BLOCKS); block < end; block++) {
+		bit = 1 << (block % 32);
+		if (known)
+			erase_known[block / 32] |= bit;
+		else
+			erase_known[block / 32] &= ~bit;
+		if (known && erased)
+			erase_map[block / 32] |= bit;
+		else
+			erase_map[block / 32] &= ~bit;
+	}
+}
+
+#ifdef CONFIG_FLASH_STATS
+/**
+ * Load the wear record from flash, if it hasn't been already.
+ */
+static void wear_load(void)
+{
+	const uint32_t *rec;
+
+	if (wear_loaded)
+		return;
+
+	memset(wear, 0, sizeof(wear));
+	wear[0] = WEAR_MAGIC;
+
+	/* Find the last record */
+	for (wear_slot = 0; wear_slot < WEAR_SLOTS; wear_slot++) {
+		rec = (const uint32_t *)
+			flash_physical_dataptr(WEAR_SLOT_OFFSET(wear_slot));
+		if (rec[0] != WEAR_MAGIC)
+			break;
+		memcpy(wear, rec, sizeof(wear));
+	}
+	wear_loaded = 1;
+}
+
+/**
+ * Add an operation to a latency histogram.
+ *
+ * @param s		Stats for the type of operation
+ * @param us		Time the operation took in us
+ */
+static void op_stats_add(struct flash_op_stats *s, uint32_t us)
+{
+	int b;
+
+	for (b = 0; b < EC_FLASH_STATS_BUCKETS - 1 &&
+		     us >= EC_FLASH_STATS_BUCKET_US(b); b++)
+		;
+	s->hist[b]++;
+	s->max_us = MAX(s->max_us, us);
+}
+#endif
+
+/**
+ * Write to physical flash, keeping the erase map and stats up to date.
+ */
+static int physical_write(int offset, int size, const char *data)
+{
+	int rv;
+#ifdef CONFIG_FLASH_STATS
+	uint64_t t = get_time().val;
+#endif
+
+	erase_map_update(offset, size, 1, 0);
+	rv = flash_physical_write(offset, size, data);
+
+#ifdef CONFIG_FLASH_STATS
+	op_stats_add(&write_stats, get_time().val - t);
+#endif
+	return rv;
+}
+
+/**
+ * Erase physical flash, keeping the erase map and stats up to date.
+ */
+static int physical_erase(int offset, int size)
+{
+	int rv;
+#ifdef CONFIG_FLASH_STATS
+	uint64_t t;
+	int o;
+
+	/* Erasing a block wears it whether or not it was already blank */
+	wear_load();
+	for (o = offset; o < offset + size; o += CONFIG_FLASH_ERASE_SIZE)
+		wear[1 + o / CONFIG_FLASH_BANK_SIZE]++;
+	wear_dirty = 1;
+
+	/* Erasing the pstate bank also erases the saved wear records */
+	if (offset < PSTATE_OFFSET + PSTATE_SIZE &&
+	    offset + size > PSTATE_OFFSET) {
+		wear_slot = 0;
+		wear_dirty = 1;
+	}
+	t = get_time().val;
+#endif
+
+	rv = flash_physical_erase(offset, size);
+
+	/* A failed erase may have erased some of the blocks */
+	erase_map_update(offset, size, rv == EC_SUCCESS, 1);
+
+#ifdef CONFIG_FLASH_STATS
+	op_stats_add(&erase_stats, get_time().val - t);
+#endif
+	return rv;
+}
+
+/**
+ * Erase the pstate bank and write pstate to it.
  *
  * @param pstate	Source persistent state
  * @return EC_SUCCESS, or nonzero if error.
  */
-static int flash_write_pstate(const struct persist_state *pstate)
+static int flash_rewrite_pstate(const struct persist_state *pstate)
 {
-	struct persist_state current_pstate;
 	int rv;
 
-	/* Check if pstate has actually changed */
-	flash_read_pstate(&current_pstate);
-	if (!memcmp(&current_pstate, pstate, sizeof(*pstate)))
-		return EC_SUCCESS;
-
 	/* Erase pstate */
-	rv = flash_physical_erase(PSTATE_OFFSET, PSTATE_SIZE);
+	rv = physical_erase(PSTATE_OFFSET, PSTATE_SIZE);
 	if (rv)
 		return rv;
 
@@ -96,33 +285,234 @@ static int flash_write_pstate(const struct persist_state *pstate)
 	 */
 
 	/* Rewrite the data */
-	return flash_physical_write(PSTATE_OFFSET, sizeof(*pstate),
-				    (const char *)pstate);
+	rv = physical_write(PSTATE_OFFSET, sizeof(*pstate),
+			    (const char *)pstate);
+
+#ifdef CONFIG_FLASH_STATS
+	/* Save the wear record, which includes the erase above */
+	if (rv == EC_SUCCESS) {
+		rv = physical_write(WEAR_SLOT_OFFSET(0), sizeof(wear),
+				    (const char *)wear);
+		wear_slot = 1;
+		if (rv == EC_SUCCESS)
+			wear_dirty = 0;
+	}
+#endif
+	return rv;
 }
 
+/**
+ * Write persistent state from pstate, erasing if necessary.
+ *
+ * @param pstate	Source persistent state
+ * @return EC_SUCCESS, or nonzero if error.
+ */
+static int flash_write_pstate(const struct persist_state *pstate)
+{
+	struct persist_state current_pstate;
+
+	/* Check if pstate has actually changed */
+	flash_read_pstate(&current_pstate);
+	if (!memcmp(&current_pstate, pstate, sizeof(*pstate)))
+		return EC_SUCCESS;
+
+	return flash_rewrite_pstate(pstate);
+}
+
+#ifdef CONFIG_FLASH_STATS
+/**
+ * Append the wear record to the pstate bank, if it has changed and the bank
+ * isn't protected.
+ *
+ * Never erases the bank.  Once its free slots are used up, the record is
+ * only saved the next time pstate is rewritten.
+ */
+static void wear_save(void)
+{
+	int offset;
+
+	if (!wear_dirty || wear_slot >= WEAR_SLOTS ||
+	    flash_physical_get_protect(PSTATE_BANK))
+		return;
+
+	offset = WEAR_SLOT_OFFSET(wear_slot);
+	if (!flash_is_erased(offset, sizeof(wear))) {
+		/* Damaged slot; don't write after it */
+		wear_slot = WEAR_SLOTS;
+		return;
+	}
+
+	if (physical_write(offset, sizeof(wear), (const char *)wear) ==
+	    EC_SUCCESS)
+		wear_dirty = 0;
+	wear_slot++;
+}
+DECLARE_DEFERRED(wear_save);
+DECLARE_HOOK(HOOK_SYSJUMP, wear_save, HOOK_PRIO_DEFAULT);
+#endif
+
+#ifdef CONFIG_FLASH_WRITE_COMBINE
+/**
+ * Program the write-combining buffer to flash.
+ *
+ * Must be called with wc_lock held.
+ *
+ * @return EC_SUCCESS, or nonzero if error.
+ */
+static int write_combine_flush(void)
+{
+	int rv;
+
+	if (!wc_size)
+		return EC_SUCCESS;
+
+	rv = physical_write(wc_offset, wc_size, (const char *)wc_buf);
+	wc_size = 0;
+	return rv;
+}
+
+int flash_write_flush(void)
+{
+	int rv;
+
+	mutex_lock(&wc_lock);
+	rv = write_combine_flush();
+	mutex_unlock(&wc_lock);
+
+	return rv;
+}
+
+static void flash_write_flush_deferred(void)
+{
+	flash_write_flush();
+}
+DECLARE_DEFERRED(flash_write_flush_deferred);
+
+/**
+ * Write to flash through the write-combining buffer.
+ *
+ * Writes which continue the buffered data are appended to it.  The buffer is
+ * programmed when it fills up to a CONFIG_FLASH_WRITE_IDEAL_SIZE boundary, or
+ * when a write does not continue it.  Whole aligned blocks of the ideal size
+ * bypass the buffer.
+ */
+static int write_combine(int offset, int size, const char *data)
+{
+	const int mask = CONFIG_FLASH_WRITE_IDEAL_SIZE - 1;
+	int rv = EC_SUCCESS;
+	int end, n;
+
+	mutex_lock(&wc_lock);
+
+	while (size > 0) {
+		/* Flush buffered data if this write doesn't continue it */
+		if (wc_size && offset != wc_offset + wc_size) {
+			rv = write_combine_flush();
+			if (rv)
+				break;
+		}
+
+		if (!wc_size && !(offset & mask) && size > mask) {
+			/* Program whole blocks directly */
+			n = size & ~mask;
+			rv = physical_write(offset, n, data);
+		} else {
+			/* Buffer up to the next ideal size boundary */
+			end = (offset | mask) + 1;
+			n = MIN(size, end - offset);
+			if (!wc_size)
+				wc_offset = offset;
+			memcpy((char *)wc_buf + wc_size, data, n);
+			wc_size += n;
+			if (offset + n == end)
+				rv = write_combine_flush();
+		}
+		if (rv)
+			break;
+
+		offset += n;
+		size -= n;
+		data += n;
+	}
+
+	n = wc_size;
+	mutex_unlock(&wc_lock);
+
+	/* Make sure a partial buffer doesn't linger indefinitely */
+	if (n)
+		hook_call_deferred(flash_write_flush_deferred,
+				   WRITE_COMBINE_FLUSH_DELAY_US);
+
+	return rv;
+}
+#endif
+
 int flash_dataptr(int offset, int size_req, int align, const char **ptrp)
 {
 	if (offset < 0 || size_req < 0 ||
 			offset + size_req > CONFIG_FLASH_SIZE ||
 			(offset | size_req) & (align - 1))
 		return -1;  /* Invalid range */
-	if (ptrp)
+	if (ptrp) {
+#ifdef CONFIG_FLASH_WRITE_COMBINE
+		/* Direct readers must see buffered writes */
+		if (wc_size)
+			flash_write_flush();
+#endif
 		*ptrp = flash_physical_dataptr(offset);
+	}
 
 	return CONFIG_FLASH_SIZE - offset;
 }
 
+/**
+ * Check if words of flash are erased.
+ *
+ * @param ptr		Pointer to flash memory
+ * @param size		Number of bytes to check (word-aligned)
+ * @return 1 if erased, 0 if not erased
+ */
+static int scan_erased(const uint32_t *ptr, int size)
+{
+	for (size /= sizeof(uint32_t); size > 0; size--, ptr++)
+		if (*ptr != CONFIG_FLASH_ERASED_VALUE32)
+			return 0;
+
+	return 1;
+}
+
 int flash_is_erased(uint32_t offset, int size)
 {
 	const uint32_t *ptr;
+	uint32_t bit;
+	int block, n, erased;
 
 	if (flash_dataptr(offset, size, sizeof(uint32_t),
 			  (const char **)&ptr) < 0)
 		return 0;
 
-	for (size /= sizeof(uint32_t); size > 0; size -= 4, ptr++)
-		if (*ptr != CONFIG_FLASH_ERASED_VALUE32)
+	for (; size > 0; size -= n, offset += n, ptr += n / sizeof(*ptr)) {
+		block = offset / CONFIG_FLASH_ERASE_SIZE;
+		bit = 1 << (block % 32);
+		n = MIN(size, CONFIG_FLASH_ERASE_SIZE -
+			offset % CONFIG_FLASH_ERASE_SIZE);
+
+		if (erase_map[block / 32] & bit)
+			continue;  /* Whole block is erased */
+
+		if (erase_known[block / 32] & bit) {
+			/* Block isn't erased, but part of it may be */
+			if (n == CONFIG_FLASH_ERASE_SIZE)
+				return 0;
+			erased = scan_erased(ptr, n);
+		} else {
+			erased = scan_erased(ptr, n);
+			if (n == CONFIG_FLASH_ERASE_SIZE)
+				erase_map_update(offset, n, 1, erased);
+		}
+		if (!erased)
 			return 0;
+	}
 
 	return 1;
 }
@@ -136,11 +526,17 @@ test_mockable int flash_write(int offset, int size, const char *data)
 	vboot_hash_invalidate(offset, size);
 #endif
 
-	return flash_physical_write(offset, size, data);
+#ifdef CONFIG_FLASH_WRITE_COMBINE
+	return write_combine(offset, size, data);
+#else
+	return physical_write(offset, size, data);
+#endif
 }
 
 test_mockable int flash_erase(int offset, int size)
 {
+	int rv;
+
 	if (flash_dataptr(offset, size, CONFIG_FLASH_ERASE_SIZE, NULL) < 0)
 		return EC_ERROR_INVAL;  /* Invalid range */
 
@@ -148,7 +544,21 @@ test_mockable int flash_erase(int offset, int size)
 	vboot_hash_invalidate(offset, size);
 #endif
 
-	return flash_physical_erase(offset, size);
+#ifdef CONFIG_FLASH_WRITE_COMBINE
+	/* Buffered writes must land before the erase, not after it */
+	rv = flash_write_flush();
+	if (rv)
+		return rv;
+#endif
+
+	rv = physical_erase(offset, size);
+
+#ifdef CONFIG_FLASH_STATS
+	if (wear_dirty)
+		hook_call_deferred(wear_save, WEAR_SAVE_DELAY_US);
+#endif
+
+	return rv;
 }
 
 int flash_protect_ro_at_boot(int enable)
@@ -381,6 +791,41 @@ DECLARE_CONSOLE_COMMAND(flashinfo, command_flash_info,
 			"Print flash info",
 			NULL);
 
+#ifdef CONFIG_FLASH_STATS
+static void print_op_stats(const char *name, const struct flash_op_stats *s)
+{
+	int i;
+
+	ccprintf("%s: max %d us\n", name, s->max_us);
+	for (i = 0; i < EC_FLASH_STATS_BUCKETS - 1; i++)
+		ccprintf("  < %6d us: %d\n", EC_FLASH_STATS_BUCKET_US(i),
+			 s->hist[i]);
+	ccprintf("  >=%6d us: %d\n", EC_FLASH_STATS_BUCKET_US(i - 1),
+		 s->hist[i]);
+}
+
+static int command_flash_stats(int argc, char **argv)
+{
+	int i;
+
+	print_op_stats("Write", &write_stats);
+	print_op_stats("Erase", &erase_stats);
+
+	wear_load();
+	ccprintf("Erases by bank%s:\n", wear_dirty ? " (not saved)" : "");
+	for (i = 0; i < PHYSICAL_BANKS; i++) {
+		if (wear[1 + i])
+			ccprintf("  %3d: %d\n", i, wear[1 + i]);
+	}
+
+	return EC_SUCCESS;
+}
+DECLARE_CONSOLE_COMMAND(flashstats, command_flash_stats,
+			NULL,
+			"Print flash wear and latency stats",
+			NULL);
+#endif
+
 static int command_flash_erase(int argc, char **argv)
 {
 	int offset = -1;
@@ -434,6 +879,10 @@ static int command_flash_write(int argc, char **argv)
 	ccprintf("Writing %d bytes to 0x%x...\n",
 		 size, offset, offset);
 	rv = flash_write(offset, size, data);
+#ifdef CONFIG_FLASH_WRITE_COMBINE
+	if (rv == EC_SUCCESS)
+		rv = flash_write_flush();
+#endif
 
 	/* Free the buffer */
 	shared_mem_release(data);
@@ -471,9 +920,32 @@ DECLARE_CONSOLE_COMMAND(flashwp, command_flash_wp,
 /*****************************************************************************/
 /* Host commands */
 
+#ifdef CONFIG_FLASH_STATS
+/**
+ * Fill in the version 2 fields of the flash info response.
+ */
+static void flash_info_stats(struct ec_response_flash_info_2 *r)
+{
+	int i;
+
+	wear_load();
+	r->erase_count_total = 0;
+	r->erase_count_max = 0;
+	for (i = 1; i <= PHYSICAL_BANKS; i++) {
+		r->erase_count_total += wear[i];
+		r->erase_count_max = MAX(r->erase_count_max, wear[i]);
+	}
+
+	r->write_max_us = write_stats.max_us;
+	r->erase_max_us = erase_stats.max_us;
+	memcpy(r->write_hist, write_stats.hist, sizeof(r->write_hist));
+	memcpy(r->erase_hist, erase_stats.hist, sizeof(r->erase_hist));
+}
+#endif
+
 static int flash_command_get_info(struct host_cmd_handler_args *args)
 {
-	struct ec_response_flash_info_1 *r = args->response;
+	struct ec_response_flash_info_2 *r = args->response;
 
 	r->flash_size = CONFIG_FLASH_SIZE;
 	r->write_block_size = CONFIG_FLASH_WRITE_SIZE;
@@ -510,19 +982,67 @@ static int flash_command_get_info(struct host_cmd_handler_args *args)
 		r->flags |= EC_FLASH_INFO_ERASE_TO_0;
 #endif
 
+		args->response_size = sizeof(struct ec_response_flash_info_1);
+	}
+
+#ifdef CONFIG_FLASH_STATS
+	if (args->version >= 2) {
+		flash_info_stats(r);
 		args->response_size = sizeof(*r);
 	}
+#endif
 	return EC_RES_SUCCESS;
 }
 DECLARE_HOST_COMMAND(EC_CMD_FLASH_INFO,
 		     flash_command_get_info,
+#ifdef CONFIG_FLASH_STATS
+		     EC_VER_MASK(2) |
+#endif
 		     EC_VER_MASK(0) | EC_VER_MASK(1));
 
+/**
+ * Flash read command, version 1: read several regions at once
+ */
+static int flash_command_read_multi(struct host_cmd_handler_args *args)
+{
+	const struct ec_params_flash_read_multi *p = args->params;
+	struct ec_params_flash_read region[EC_FLASH_READ_MULTI_MAX];
+	uint8_t *out = args->response;
+	const char *src;
+	int count = p->count;
+	int i;
+
+	if (count > EC_FLASH_READ_MULTI_MAX ||
+	    sizeof(*p) + count * sizeof(region[0]) > args->params_size)
+		return EC_RES_INVALID_PARAM;
+
+	/* The response may overwrite the params, so save the regions first */
+	memcpy(region, p->region, count * sizeof(region[0]));
+
+	args->response_size = 0;
+	for (i = 0; i < count; i++) {
+		if (flash_dataptr(region[i].offset, region[i].size, 1,
+				  &src) < 0)
+			return EC_RES_ERROR;
+
+		if (region[i].size > args->response_max - args->response_size)
+			return EC_RES_OVERFLOW;
+
+		memcpy(out + args->response_size, src, region[i].size);
+		args->response_size += region[i].size;
+	}
+
+	return EC_RES_SUCCESS;
+}
+
 static int flash_command_read(struct host_cmd_handler_args *args)
 {
 	const struct ec_params_flash_read *p = args->params;
 	const char *src;
 
+	if (args->version == EC_VER_FLASH_READ_MULTI)
+		return flash_command_read_multi(args);
+
 	if (flash_dataptr(p->offset, p->size, 1, &src) < 0)
 		return EC_RES_ERROR;
 
@@ -536,6 +1056,67 @@ static int flash_command_read(struct host_cmd_handler_args *args)
 }
 DECLARE_HOST_COMMAND(EC_CMD_FLASH_READ,
 		     flash_command_read,
+		     EC_VER_MASK(0) | EC_VER_MASK(EC_VER_FLASH_READ_MULTI));
+
+static int flash_command_block_crc(struct host_cmd_handler_args *args)
+{
+	const struct ec_params_flash_block_crc *p = args->params;
+	uint32_t *crc = args->response;
+	int offset = p->offset;
+	int block_size = p->block_size;
+	int count = p->count;
+	const char *src;
+	int i;
+
+	if (block_size <= 0 || count < 0 ||
+	    count > (int)(args->response_max / sizeof(*crc)) ||
+	    count > CONFIG_FLASH_SIZE / block_size)
+		return EC_RES_INVALID_PARAM;
+
+	if (flash_dataptr(offset, block_size * count, 1, &src) < 0)
+		return EC_RES_ERROR;
+
+	/* Params were saved above, so the response may overwrite them */
+	for (i = 0; i < count; i++, src += block_size)
+		crc[i] = ec_crc32_add(0, src, block_size);
+
+	args->response_size = count * sizeof(*crc);
+
+	return EC_RES_SUCCESS;
+}
+DECLARE_HOST_COMMAND(EC_CMD_FLASH_BLOCK_CRC,
+		     flash_command_block_crc,
+		     EC_VER_MASK(0));
+
+static int flash_command_erased_map(struct host_cmd_handler_args *args)
+{
+	const struct ec_params_flash_erased_map *p = args->params;
+	uint8_t *map = args->response;
+	int offset = p->offset;
+	int count = p->count;
+	int size = (count + 7) / 8;
+	int i;
+
+	if (count < 0 || size > args->response_max ||
+	    count > ERASE_BLOCKS)
+		return EC_RES_INVALID_PARAM;
+
+	if (flash_dataptr(offset, count * CONFIG_FLASH_ERASE_SIZE,
+			  CONFIG_FLASH_ERASE_SIZE, NULL) < 0)
+		return EC_RES_ERROR;
+
+	/* Params were saved above, so the response may overwrite them */
+	memset(map, 0, size);
+	for (i = 0; i < count; i++, offset += CONFIG_FLASH_ERASE_SIZE)
+		if (flash_is_erased(offset, CONFIG_FLASH_ERASE_SIZE))
+			map[i / 8] |= 1 << (i % 8);
+
+	args->response_size = size;
+
+	return EC_RES_SUCCESS;
+}
+DECLARE_HOST_COMMAND(EC_CMD_FLASH_ERASED_MAP,
+		     flash_command_erased_map,
 		     EC_VER_MASK(0));
 
 /**
@@ -560,6 +1141,12 @@ static int flash_command_write(struct host_cmd_handler_args *args)
 	if (flash_write(p->offset, p->size, (const uint8_t *)(p + 1)))
 		return EC_RES_ERROR;
 
+#ifdef CONFIG_FLASH_WRITE_COMBINE
+	/* The host expects the data to be in flash once the command returns */
+	if (flash_write_flush())
+		return EC_RES_ERROR;
+#endif
+
 	return EC_RES_SUCCESS;
 }
 DECLARE_HOST_COMMAND(EC_CMD_FLASH_WRITE,
@@ -569,19 +1156,20 @@ DECLARE_HOST_COMMAND(EC_CMD_FLASH_WRITE,
 static int flash_command_erase(struct host_cmd_handler_args *args)
 {
 	const struct ec_params_flash_erase *p = args->params;
+	int offset = p->offset;
+	int size = p->size;
 
 	if (flash_get_protect() & EC_FLASH_PROTECT_ALL_NOW)
 		return EC_RES_ACCESS_DENIED;
 
-	if (system_unsafe_to_overwrite(p->offset, p->size))
+	if (system_unsafe_to_overwrite(offset, size))
 		return EC_RES_ACCESS_DENIED;
 
 	/* Indicate that we might be a while */
 #ifdef HAS_TASK_HOSTCMD
-	args->result = EC_RES_IN_PROGRESS;
-	host_send_response(args);
+	host_command_in_progress(args);
 #endif
-	if (flash_erase(p->offset, p->size))
+	if (flash_erase(offset, size))
 		return EC_RES_ERROR;
 
 	return EC_RES_SUCCESS;
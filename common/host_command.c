@@ -7,6 +7,7 @@
 
 #include "common.h"
 #include "console.h"
+#include "ec_checksum.h"
 #include "host_command.h"
 #include "link_defs.h"
 #include "lpc.h"
@@ -25,7 +26,29 @@
 /* Maximum delay to skip printing repeated host command debug output */
 #define HCDEBUG_MAX_REPEAT_DELAY (50 * MSEC)
 
-static struct host_cmd_handler_args *pending_args;
+/*
+ * Commands waiting for the host command task.  Host interface drivers add
+ * commands from their interrupt handlers; only the host command task removes
+ * them, so responses are sent in the order the commands arrived.  The head
+ * and tail are free-running; the command at the head stays queued until its
+ * handler has finished, so it still counts as pending.
+ */
+BUILD_ASSERT((CONFIG_HOST_COMMAND_QUEUE_SIZE &
+	      (CONFIG_HOST_COMMAND_QUEUE_SIZE - 1)) == 0);
+static struct host_cmd_handler_args *cmd_queue[CONFIG_HOST_COMMAND_QUEUE_SIZE];
+static uint32_t cmd_queue_head;  /* Next command to process */
+static uint32_t cmd_queue_tail;  /* Next free entry */
+
+#define CMD_QUEUE_ENTRY(n) cmd_queue[(n) & (CONFIG_HOST_COMMAND_QUEUE_SIZE - 1)]
+
+/*
+ * Indices into the host command table, sorted by command number at init so
+ * find_host_command() can bisect them.  hcmd_count stays 0 until then, or if
+ * the table has more entries than fit here.
+ */
+#define HCMD_INDEX_MAX 128
+static uint8_t hcmd_index[HCMD_INDEX_MAX];
+static int hcmd_count;
 
 #ifndef CONFIG_LPC
 /*
@@ -48,6 +71,14 @@ static enum {
 static const char * const hcdebug_mode_names[HCDEBUG_MODES] = {
 	"off", "normal", "every", "params"};
 
+#ifdef CONFIG_HOST_COMMAND_STATS
+/* Histogram of command execution times; see EC_HCSTATS_HISTOGRAM_BUCKETS */
+static uint32_t hcstats_histogram[EC_HCSTATS_HISTOGRAM_BUCKETS];
+#endif
+
+/* Command being run by the host command task */
+static struct host_cmd_handler_args *current_args;
+
 #ifdef CONFIG_HOST_COMMAND_STATUS
 /*
  * Indicates that a 'slow' command has sent EC_RES_IN_PROGRESS but hasn't
@@ -55,8 +86,18 @@ static const char * const hcdebug_mode_names[HCDEBUG_MODES] = {
  */
 static uint8_t command_pending;
 
-/* The result of the last 'slow' operation */
+/*
+ * Once a slow command has sent its interim response, the driver may reuse
+ * its args and buffers for the next command.  The command carries on with
+ * these args instead, and its final response is saved here until the host
+ * asks for it with EC_CMD_RESEND_RESPONSE.
+ */
+static struct host_cmd_handler_args async_args;
+static uint8_t async_response[HOST_ASYNC_RESPONSE_MAX] __aligned(4);
+
+/* The result and response size of the last 'slow' operation */
 static uint8_t saved_result = EC_RES_UNAVAILABLE;
+static uint16_t saved_response_size;
 #endif
 
 uint8_t *host_get_memmap(int offset)
@@ -69,57 +110,105 @@ uint8_t *host_get_memmap(int offset)
 }
 
 test_mockable void host_send_response(struct host_cmd_handler_args *args)
+{
+	args->send_response(args);
+}
+
+struct host_cmd_handler_args *host_command_in_progress(
+	struct host_cmd_handler_args *args)
 {
 #ifdef CONFIG_HOST_COMMAND_STATUS
 	/*
-	 * TODO(sjg@chromium.org):
-	 * If we got an 'in progress' previously, then this
-	 * must be the completion of that command, so stash the result
-	 * code. We can't send it back to the host now since we already sent
-	 * the in-progress response and the host is on to other things now.
-	 *
-	 * If we are in interrupt context, then we are handling a
-	 * get_status response or an immediate error which prevented us
-	 * from processing the command. Note we can't check for the
-	 * GET_COMMS_STATUS command in args->command because the original
-	 * command value has now been overwritten.
-	 *
-	 * When a EC_CMD_RESEND_RESPONSE arrives we will supply this response
-	 * to that command.
-	 *
-	 * We don't support stashing response data, so mark the response as
-	 * unavailable in that case.
-	 *
-	 * TODO(sjg@chromium.org): If we stashed the command in host_command
-	 * before processing it, then it would not get overwritten by a
-	 * subsequent command and we could simplify the logic here by adding
-	 * a flag to host_cmd_handler_args to indicate that the command had
-	 * an interim response. We would have to make this stashing dependent
-	 * on CONFIG_HOST_COMMAND_STATUS also.
+	 * Only a command run by the host command task can finish after its
+	 * response has been sent.  Anything else (console, batched
+	 * sub-commands) just runs to completion.
 	 */
-	if (!in_interrupt_context()) {
-		if (command_pending) {
-			CPRINTF("pending complete, size=%d, result=%d\n",
-				args->response_size, args->result);
-			if (args->response_size != 0)
-				saved_result = EC_RES_UNAVAILABLE;
-			else
-				saved_result = args->result;
-			command_pending = 0;
-			return;
-		} else if (args->result == EC_RES_IN_PROGRESS) {
-			command_pending = 1;
-			CPRINTF("Command pending\n");
-		}
+	if (args != current_args || command_pending)
+		return args;
+
+	async_args = *args;
+	async_args.params = NULL;
+	async_args.params_size = 0;
+	async_args.response = async_response;
+	async_args.response_max = sizeof(async_response);
+	async_args.response_size = 0;
+	async_args.result = EC_RES_IN_PROGRESS;
+
+	/* The queue entry no longer refers to the driver's args */
+	CMD_QUEUE_ENTRY(cmd_queue_head) = &async_args;
+	command_pending = 1;
+	CPRINTF("[%T HC 0x%02x pending]\n", args->command);
+
+	/* Release the host interface */
+	args->result = EC_RES_IN_PROGRESS;
+	args->response_size = 0;
+	host_send_response(args);
+
+	return &async_args;
+#else
+	return args;
+#endif
+}
+
+#ifdef CONFIG_HOST_COMMAND_STATUS
+/**
+ * Save the final result of a command which sent an interim response.
+ *
+ * @param rv		Result returned by the command handler
+ */
+static void host_command_save_response(enum ec_status rv)
+{
+	saved_result = rv;
+	saved_response_size = 0;
+	if (rv == EC_RES_SUCCESS) {
+		if (async_args.response_size > async_args.response_max)
+			saved_result = EC_RES_RESPONSE_TOO_BIG;
+		else
+			saved_response_size = async_args.response_size;
 	}
+
+	CPRINTF("[%T HC 0x%02x pending complete, size=%d, result=%d]\n",
+		async_args.command, saved_response_size, saved_result);
+	command_pending = 0;
+}
 #endif
-	args->send_response(args);
+
+/**
+ * Add a command to the queue for the host command task.
+ *
+ * @param args		Command to queue
+ * @return EC_RES_SUCCESS if queued, EC_RES_BUSY if the queue is full, or
+ *	   EC_RES_IN_PROGRESS if the command is already queued.
+ */
+static enum ec_status host_command_enqueue(struct host_cmd_handler_args *args)
+{
+	enum ec_status rv = EC_RES_SUCCESS;
+	uint32_t i;
+
+	interrupt_disable();
+
+	for (i = cmd_queue_head; i != cmd_queue_tail; i++) {
+		if (CMD_QUEUE_ENTRY(i) == args) {
+			rv = EC_RES_IN_PROGRESS;
+			goto enqueue_done;
+		}
+	}
+
+	if (cmd_queue_tail - cmd_queue_head >= CONFIG_HOST_COMMAND_QUEUE_SIZE) {
+		rv = EC_RES_BUSY;
+		goto enqueue_done;
+	}
+
+	CMD_QUEUE_ENTRY(cmd_queue_tail) = args;
+	cmd_queue_tail++;
+
+enqueue_done:
+	interrupt_enable();
+	return rv;
 }
 
 void host_command_received(struct host_cmd_handler_args *args)
 {
-	/* TODO: should warn if we already think we're in a command */
-
 	/*
 	 * If this is the reboot command, reboot immediately.  This gives the
 	 * host processor a way to unwedge the EC even if it's busy with some
@@ -138,34 +227,83 @@ void host_command_received(struct host_cmd_handler_args *args)
 		args->result = host_command_process(args);
 #endif
 	} else {
-		/* Save the command */
-		pending_args = args;
-
-		/* Wake up the task to handle the command */
-		task_set_event(TASK_ID_HOSTCMD, TASK_EVENT_CMD_PENDING, 0);
-		return;
+		switch (host_command_enqueue(args)) {
+		case EC_RES_SUCCESS:
+			/* Wake up the task to handle the command */
+			task_set_event(TASK_ID_HOSTCMD,
+				       TASK_EVENT_CMD_PENDING, 0);
+			return;
+		case EC_RES_IN_PROGRESS:
+			/*
+			 * The driver handed us a command which hasn't been
+			 * answered yet.  Its response will follow once the
+			 * command is processed, so don't answer it twice.
+			 */
+			CPRINTF("[%T HC 0x%02x already pending]\n",
+				args->command);
+			return;
+		default:
+			args->result = EC_RES_BUSY;
+			break;
+		}
 	}
 
 	/* Send the response now */
 	host_send_response(args);
 }
 
-/* TODO(rspangler): less awful names. */
-static struct host_cmd_handler_args args0;
-static struct host_packet *pkt0;
+/*
+ * Handler args for packets in flight.  Each received packet gets its own slot
+ * until its response has been sent, so that packets from different interfaces
+ * can be queued while another one is still being processed.  A slot is free
+ * when pkt is NULL.
+ */
+struct host_packet_slot {
+	struct host_cmd_handler_args args;  /* Must be first */
+	struct host_packet *pkt;
+};
+static struct host_packet_slot pkt_slots[CONFIG_HOST_COMMAND_QUEUE_SIZE];
 
-void host_packet_respond(struct host_cmd_handler_args *args)
+/**
+ * Claim a free packet slot.
+ *
+ * @param pkt		Packet to track
+ * @return The slot, or NULL if all slots are in use.
+ */
+static struct host_packet_slot *host_packet_slot_alloc(struct host_packet *pkt)
 {
-	struct ec_host_response *r = (struct ec_host_response *)pkt0->response;
-	uint8_t *out = (uint8_t *)pkt0->response;
-	int csum = 0;
+	struct host_packet_slot *slot = NULL;
 	int i;
 
+	interrupt_disable();
+	for (i = 0; i < ARRAY_SIZE(pkt_slots); i++) {
+		if (!pkt_slots[i].pkt) {
+			slot = pkt_slots + i;
+			slot->pkt = pkt;
+			break;
+		}
+	}
+	interrupt_enable();
+
+	return slot;
+}
+
+/**
+ * Fill in the response header for a packet and send it.
+ *
+ * @param pkt		Packet to respond to
+ * @param args		Handler args holding the result
+ */
+static void host_packet_send(struct host_packet *pkt,
+			     struct host_cmd_handler_args *args)
+{
+	struct ec_host_response *r = (struct ec_host_response *)pkt->response;
+
 	/* Clip result size to what we can accept */
 	if (args->result) {
 		/* Error results don't have data */
 		args->response_size = 0;
-	} else if (args->response_size > pkt0->response_max - sizeof(*r)) {
+	} else if (args->response_size > pkt->response_max - sizeof(*r)) {
 		/* Too much data */
 		args->result = EC_RES_RESPONSE_TOO_BIG;
 		args->response_size = 0;
@@ -178,20 +316,25 @@ void host_packet_respond(struct host_cmd_handler_args *args)
 	r->data_len = args->response_size;
 	r->reserved = 0;
 
-	/* Start checksum; this also advances *out to end of response */
-	for (i = sizeof(*r); i > 0; i--)
-		csum += *out++;
+	/* Write checksum field so the entire packet sums to 0 */
+	r->checksum = (uint8_t)(-ec_checksum_add(0, r,
+						 sizeof(*r) + r->data_len));
 
-	/* Checksum response data, if any */
-	for (i = args->response_size; i > 0; i--)
-		csum += *out++;
+	pkt->response_size = sizeof(*r) + r->data_len;
+	pkt->driver_result = args->result;
+	pkt->send_response(pkt);
+}
 
-	/* Write checksum field so the entire packet sums to 0 */
-	r->checksum = (uint8_t)(-csum);
+void host_packet_respond(struct host_cmd_handler_args *args)
+{
+	struct host_packet_slot *slot = (struct host_packet_slot *)args;
 
-	pkt0->response_size = sizeof(*r) + r->data_len;
-	pkt0->driver_result = args->result;
-	pkt0->send_response(pkt0);
+	/*
+	 * The response is built from args, which lives in the slot, so only
+	 * free the slot once the response has been sent.
+	 */
+	host_packet_send(slot->pkt, args);
+	slot->pkt = NULL;
 }
 
 int host_request_expected_size(const struct ec_host_request *r)
@@ -212,29 +355,40 @@ void host_packet_receive(struct host_packet *pkt)
 {
 	const struct ec_host_request *r =
 		(const struct ec_host_request *)pkt->request;
-	const uint8_t *in = (const uint8_t *)pkt->request;
+	const uint8_t *in = (const uint8_t *)pkt->request + sizeof(*r);
 	uint8_t *itmp = (uint8_t *)pkt->request_temp;
-	int csum = 0;
-	int i;
+	struct host_packet_slot *slot;
+	struct host_cmd_handler_args *args;
+	uint8_t csum;
 
 	/* Track the packet we're handling */
-	pkt0 = pkt;
+	slot = host_packet_slot_alloc(pkt);
+	if (!slot) {
+		/* Too many packets in flight; tell the host to retry */
+		struct host_cmd_handler_args busy_args;
+
+		busy_args.result = EC_RES_BUSY;
+		busy_args.response_size = 0;
+		host_packet_send(pkt, &busy_args);
+		return;
+	}
+	args = &slot->args;
 
 	/* If driver indicates error, don't even look at the data */
 	if (pkt->driver_result) {
-		args0.result = pkt->driver_result;
+		args->result = pkt->driver_result;
 		goto host_packet_bad;
 	}
 
 	if (pkt->request_size < sizeof(*r)) {
 		/* Packet too small for even a header */
-		args0.result = EC_RES_REQUEST_TRUNCATED;
+		args->result = EC_RES_REQUEST_TRUNCATED;
 		goto host_packet_bad;
 	}
 
 	if (pkt->request_size > pkt->request_max) {
 		/* Got a bigger request than the interface can handle */
-		args0.result = EC_RES_REQUEST_TRUNCATED;
+		args->result = EC_RES_REQUEST_TRUNCATED;
 		goto host_packet_bad;
 	}
 
@@ -244,23 +398,16 @@ void host_packet_receive(struct host_packet *pkt)
 	 */
 	ASSERT(pkt->response_max >= sizeof(struct ec_host_response));
 
-	/* Start checksum and copy request header if necessary */
+	/* Copy request header if necessary */
 	if (pkt->request_temp) {
-		/* Copy to temp buffer and checksum */
-		for (i = sizeof(*r); i > 0; i--) {
-			*itmp = *in++;
-			csum += *itmp++;
-		}
-		r = (const struct ec_host_request *)pkt->request_temp;
-	} else {
-		/* Just checksum */
-		for (i = sizeof(*r); i > 0; i--)
-			csum += *in++;
+		memcpy(itmp, pkt->request, sizeof(*r));
+		r = (const struct ec_host_request *)itmp;
+		itmp += sizeof(*r);
 	}
 
 	if (r->struct_version != EC_HOST_REQUEST_VERSION) {
 		/* Request header we don't know how to handle */
-		args0.result = EC_RES_INVALID_HEADER;
+		args->result = EC_RES_INVALID_HEADER;
 		goto host_packet_bad;
 	}
 
@@ -271,75 +418,116 @@ void host_packet_receive(struct host_packet *pkt)
 		 * the data at the end (SPI) or may not know how big the
 		 * received data is (LPC).
 		 */
-		args0.result = EC_RES_REQUEST_TRUNCATED;
+		args->result = EC_RES_REQUEST_TRUNCATED;
 		goto host_packet_bad;
 	}
 
-	/* Copy request data and validate checksum */
+	/* Copy request data if necessary */
 	if (pkt->request_temp) {
 		/* Params go in temporary buffer */
-		args0.params = itmp;
-
-		/* Copy request data and checksum */
-		for (i = r->data_len; i > 0; i--) {
-			*itmp = *in++;
-			csum += *itmp++;
-		}
+		memcpy(itmp, in, r->data_len);
+		args->params = itmp;
 	} else {
 		/* Params read directly from request */
-		args0.params = in;
-
-		/* Just checksum */
-		for (i = r->data_len; i > 0; i--)
-			csum += *in++;
+		args->params = in;
 	}
 
 	/* Validate checksum */
-	if ((uint8_t)csum) {
-		args0.result = EC_RES_INVALID_CHECKSUM;
+	csum = ec_checksum_add(0, r, sizeof(*r));
+	csum = ec_checksum_add(csum, args->params, r->data_len);
+	if (csum) {
+		args->result = EC_RES_INVALID_CHECKSUM;
 		goto host_packet_bad;
 	}
 
 	/* Set up host command handler args */
-	args0.send_response = host_packet_respond;
-	args0.command = r->command;
-	args0.version = r->command_version;
-	args0.params_size = r->data_len;
-	args0.response = (struct ec_host_response *)(pkt->response) + 1;
-	args0.response_max = pkt->response_max -
+	args->send_response = host_packet_respond;
+	args->command = r->command;
+	args->version = r->command_version;
+	args->params_size = r->data_len;
+	args->response = (struct ec_host_response *)(pkt->response) + 1;
+	args->response_max = pkt->response_max -
 		sizeof(struct ec_host_response);
-	args0.response_size = 0;
-	args0.result = EC_RES_SUCCESS;
+	args->response_size = 0;
+	args->result = EC_RES_SUCCESS;
 
 	/* Chain to host command received */
-	host_command_received(&args0);
+	host_command_received(args);
 	return;
 
 host_packet_bad:
 	/* Improperly formed packet from host, so send an error response */
-	host_packet_respond(&args0);
+	host_packet_respond(args);
 }
 
 /**
  * Find a command by command number.
  *
+ * Bisects the sorted indices of the host command table.  Falls back to a
+ * linear scan until host_command_init() has sorted them.
+ *
  * @param command	Command number to find
  * @return The command structure, or NULL if no match found.
  */
 static const struct host_command *find_host_command(int command)
 {
 	const struct host_command *cmd;
+	int lo = 0, hi = hcmd_count, mid;
 
-	for (cmd = __hcmds; cmd < __hcmds_end; cmd++) {
+	if (!hcmd_count) {
+		for (cmd = __hcmds; cmd < __hcmds_end; cmd++) {
+			if (command == cmd->command)
+				return cmd;
+		}
+		return NULL;
+	}
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		cmd = __hcmds + hcmd_index[mid];
 		if (command == cmd->command)
 			return cmd;
+		if (command < cmd->command)
+			hi = mid;
+		else
+			lo = mid + 1;
 	}
 
 	return NULL;
 }
 
+/**
+ * Sort the host command table indices by command number.
+ */
+static void host_command_sort(void)
+{
+	int count = __hcmds_end - __hcmds;
+	int i, j;
+	uint8_t n;
+
+	if (count > HCMD_INDEX_MAX) {
+		CPRINTF("[%T hostcmd table too big to sort (%d)]\n", count);
+		return;
+	}
+
+	/* Insertion sort; the table is short and only sorted once */
+	for (i = 0; i < count; i++) {
+		n = i;
+		for (j = i; j > 0; j--) {
+			if (__hcmds[hcmd_index[j - 1]].command <
+			    __hcmds[n].command)
+				break;
+			hcmd_index[j] = hcmd_index[j - 1];
+		}
+		hcmd_index[j] = n;
+	}
+	hcmd_count = count;
+}
+
 static void host_command_init(void)
 {
+	host_command_sort();
+
 	/* Initialize memory map ID area */
 	host_get_memmap(EC_MEMMAP_ID)[0] = 'E';
 	host_get_memmap(EC_MEMMAP_ID)[1] = 'C';
@@ -352,17 +540,41 @@ static void host_command_init(void)
 
 void host_command_task(void)
 {
+	struct host_cmd_handler_args *args;
+	enum ec_status rv;
+
 	host_command_init();
 
 	while (1) {
 		/* Wait for the next command event */
 		int evt = task_wait_event(-1);
 
-		/* Process it */
-		if ((evt & TASK_EVENT_CMD_PENDING) && pending_args) {
-			pending_args->result =
-					host_command_process(pending_args);
-			host_send_response(pending_args);
+		if (!(evt & TASK_EVENT_CMD_PENDING))
+			continue;
+
+		/* Process queued commands in the order they arrived */
+		while (cmd_queue_head != cmd_queue_tail) {
+			args = CMD_QUEUE_ENTRY(cmd_queue_head);
+			current_args = args;
+			rv = host_command_process(args);
+			current_args = NULL;
+
+			/*
+			 * Dequeue before responding, since the driver may
+			 * reuse the args for its next command as soon as the
+			 * response is sent.
+			 */
+			cmd_queue_head++;
+
+#ifdef CONFIG_HOST_COMMAND_STATUS
+			/* Interim response already sent; keep the result */
+			if (command_pending) {
+				host_command_save_response(rv);
+				continue;
+			}
+#endif
+			args->result = rv;
+			host_send_response(args);
 		}
 	}
 }
@@ -502,20 +714,94 @@ static void host_command_debug_request(struct host_cmd_handler_args *args)
 		CPRINTF("[%T HC 0x%02x]\n", args->command);
 }
 
+#ifdef CONFIG_HOST_COMMAND_STATS
+/**
+ * Update the statistics for a command which has been run.
+ *
+ * @param cmd		Command which was run
+ * @param args		Host command args
+ * @param rv		Result returned by the command handler
+ * @param us		Execution time in us
+ */
+static void host_command_stats_record(const struct host_command *cmd,
+				      const struct host_cmd_handler_args *args,
+				      enum ec_status rv, uint32_t us)
+{
+	struct host_command_stats *st = cmd->stats;
+	int bucket = us ? 32 - __builtin_clz(us) : 0;
+
+	if (!st->calls || us < st->min_us)
+		st->min_us = us;
+	if (us > st->max_us)
+		st->max_us = us;
+	st->total_us += us;
+	st->calls++;
+	if (rv != EC_RES_SUCCESS)
+		st->errors++;
+
+	/* Slow commands flag an interim response in args->result */
+	if (args->result == EC_RES_IN_PROGRESS)
+		st->in_progress++;
+
+	hcstats_histogram[MIN(bucket, EC_HCSTATS_HISTOGRAM_BUCKETS - 1)]++;
+}
+
+/* Return the average execution time for a command, in us */
+static uint32_t host_command_stats_avg(const struct host_command_stats *st)
+{
+	uint64_t total = st->total_us;
+	uint32_t calls = st->calls;
+
+	/* Avoid a 64-bit divide by scaling both down until the total fits */
+	while (total >> 32) {
+		total >>= 1;
+		calls >>= 1;
+	}
+
+	return calls ? (uint32_t)total / calls : 0xffffffff;
+}
+
+static void host_command_stats_reset(void)
+{
+	const struct host_command *cmd;
+
+	for (cmd = __hcmds; cmd < __hcmds_end; cmd++)
+		memset(cmd->stats, 0, sizeof(*cmd->stats));
+	memset(hcstats_histogram, 0, sizeof(hcstats_histogram));
+}
+#endif
+
 enum ec_status host_command_process(struct host_cmd_handler_args *args)
 {
 	const struct host_command *cmd = find_host_command(args->command);
 	enum ec_status rv;
+#ifdef CONFIG_HOST_COMMAND_STATS
+	timestamp_t t0;
+#endif
 
 	if (hcdebug)
 		host_command_debug_request(args);
 
-	if (!cmd)
+	if (!cmd) {
 		rv = EC_RES_INVALID_COMMAND;
-	else if (!(EC_VER_MASK(args->version) & cmd->version_mask))
+	} else if (!(EC_VER_MASK(args->version) & cmd->version_mask)) {
 		rv = EC_RES_INVALID_VERSION;
-	else
+	} else {
+#ifdef CONFIG_HOST_COMMAND_STATS
+		args->result = EC_RES_SUCCESS;
+		t0 = get_time();
+#endif
 		rv = cmd->handler(args);
+#ifdef CONFIG_HOST_COMMAND_STATUS
+		/* After an interim response, the driver may reuse args */
+		if (args == current_args && command_pending)
+			args = &async_args;
+#endif
+#ifdef CONFIG_HOST_COMMAND_STATS
+		host_command_stats_record(cmd, args, rv,
+					  get_time().val - t0.val);
+#endif
+	}
 
 	if (rv != EC_RES_SUCCESS)
 		CPRINTF("[%T HC err %d]\n", rv);
@@ -546,13 +832,23 @@ DECLARE_HOST_COMMAND(EC_CMD_GET_COMMS_STATUS,
 /* Resend the last saved response */
 static int host_command_resend_response(struct host_cmd_handler_args *args)
 {
-	/* Handle resending response */
-	args->result = saved_result;
-	args->response_size = 0;
+	int rv = saved_result;
+
+	if (rv == EC_RES_SUCCESS) {
+		if (saved_response_size > args->response_max) {
+			rv = EC_RES_RESPONSE_TOO_BIG;
+		} else {
+			memcpy(args->response, async_response,
+			       saved_response_size);
+			args->response_size = saved_response_size;
+		}
+	}
 
+	/* Each response can only be fetched once */
 	saved_result = EC_RES_UNAVAILABLE;
+	saved_response_size = 0;
 
-	return EC_SUCCESS;
+	return rv;
 }
 
 DECLARE_HOST_COMMAND(EC_CMD_RESEND_RESPONSE,
@@ -577,6 +873,156 @@ DECLARE_HOST_COMMAND(EC_CMD_TEST_PROTOCOL,
 		     host_command_test_protocol,
 		     EC_VER_MASK(0));
 
+static int host_command_batch(struct host_cmd_handler_args *args)
+{
+	const struct ec_params_batch *p;
+	const struct ec_params_batch_cmd *req;
+	struct ec_response_batch *r = args->response;
+	struct ec_response_batch_cmd *resp;
+	struct host_cmd_handler_args sub;
+	const uint8_t *in, *in_end;
+	uint8_t *out, *out_end;
+	char *params;
+	int rv = EC_RES_SUCCESS;
+	int i;
+
+	if (args->params_size < sizeof(*p) || args->response_max < sizeof(*r))
+		return EC_RES_INVALID_PARAM;
+
+	/*
+	 * Interfaces may use the same buffer for request and response, so
+	 * copy the sub-requests before the sub-responses overwrite them.
+	 */
+	if (shared_mem_acquire(args->params_size, &params))
+		return EC_RES_BUSY;
+	memcpy(params, args->params, args->params_size);
+
+	p = (const struct ec_params_batch *)params;
+	in = (const uint8_t *)(p + 1);
+	in_end = (const uint8_t *)params + args->params_size;
+	out = (uint8_t *)(r + 1);
+	out_end = (uint8_t *)args->response + args->response_max;
+
+	/* Sub-commands can't send interim responses; they run to completion */
+	sub.send_response = NULL;
+
+	for (i = 0; i < p->count; i++) {
+		req = (const struct ec_params_batch_cmd *)in;
+		resp = (struct ec_response_batch_cmd *)out;
+
+		if (in + sizeof(*req) > in_end ||
+		    in + sizeof(*req) + req->data_len > in_end) {
+			rv = EC_RES_INVALID_PARAM;
+			break;
+		}
+
+		if (out + sizeof(*resp) > out_end) {
+			rv = EC_RES_RESPONSE_TOO_BIG;
+			break;
+		}
+
+		sub.command = req->command;
+		sub.version = req->command_version;
+		sub.params = req + 1;
+		sub.params_size = req->data_len;
+		sub.response = resp + 1;
+		sub.response_max = out_end - (uint8_t *)(resp + 1);
+		sub.response_size = 0;
+		sub.result = EC_RES_SUCCESS;
+
+		if (sub.command == EC_CMD_BATCH)
+			resp->result = EC_RES_INVALID_COMMAND;
+		else
+			resp->result = host_command_process(&sub);
+
+		/* Error results don't have data */
+		if (resp->result != EC_RES_SUCCESS)
+			sub.response_size = 0;
+		else if (sub.response_size > sub.response_max) {
+			resp->result = EC_RES_RESPONSE_TOO_BIG;
+			sub.response_size = 0;
+		}
+		resp->data_len = sub.response_size;
+
+		/* Zero the padding so the response is deterministic */
+		out = (uint8_t *)(resp + 1) + sub.response_size;
+		while (out < out_end &&
+		       (out - (uint8_t *)args->response) % EC_BATCH_ALIGN)
+			*out++ = 0;
+
+		in += EC_BATCH_PAD(sizeof(*req) + req->data_len);
+
+		if ((p->flags & EC_BATCH_FLAG_STOP_ON_ERROR) && resp->result) {
+			i++;
+			break;
+		}
+	}
+
+	shared_mem_release(params);
+
+	r->count = i;
+	memset(r->reserved, 0, sizeof(r->reserved));
+	args->response_size = out - (uint8_t *)args->response;
+
+	return rv;
+}
+DECLARE_HOST_COMMAND(EC_CMD_BATCH,
+		     host_command_batch,
+		     EC_VER_MASK(0));
+
+#ifdef CONFIG_HOST_COMMAND_STATS
+static int host_command_get_stats(struct host_cmd_handler_args *args)
+{
+	const struct ec_params_host_command_stats *p = args->params;
+	struct ec_response_host_command_stats *r = args->response;
+	struct ec_hcstats_entry *e = r->entries;
+	const struct host_command *cmd;
+	const struct host_command_stats *st;
+	int offset = p->offset;
+	int flags = p->flags;
+	int max, n = 0;
+
+	if (args->response_max < sizeof(*r))
+		return EC_RES_INVALID_PARAM;
+	max = MIN((args->response_max - sizeof(*r)) / sizeof(*e), 0xff);
+
+	memcpy(r->histogram, hcstats_histogram, sizeof(r->histogram));
+	r->count = 0;
+	r->reserved = 0;
+
+	/* List commands which have been run */
+	for (cmd = __hcmds; cmd < __hcmds_end; cmd++) {
+		st = cmd->stats;
+		if (!st->calls)
+			continue;
+		if (n++ < offset || r->count >= max)
+			continue;
+
+		e->command = cmd->command;
+		e->reserved = 0;
+		e->calls = st->calls;
+		e->errors = st->errors;
+		e->in_progress = st->in_progress;
+		e->min_us = st->min_us;
+		e->max_us = st->max_us;
+		e->avg_us = host_command_stats_avg(st);
+		e++;
+		r->count++;
+	}
+	r->total = n;
+
+	args->response_size = sizeof(*r) + r->count * sizeof(*e);
+
+	if (flags & EC_HCSTATS_FLAG_RESET)
+		host_command_stats_reset();
+
+	return EC_RES_SUCCESS;
+}
+DECLARE_HOST_COMMAND(EC_CMD_HOST_COMMAND_STATS,
+		     host_command_get_stats,
+		     EC_VER_MASK(0));
+#endif
+
 /*****************************************************************************/
 /* Console commands */
 
@@ -705,3 +1151,41 @@ DECLARE_CONSOLE_COMMAND(hcdebug, command_hcdebug,
 			"hcdebug [off | normal | every | params]",
 			"Set host command debug output mode",
 			NULL);
+
+#ifdef CONFIG_HOST_COMMAND_STATS
+static int command_hcstats(int argc, char **argv)
+{
+	const struct host_command *cmd;
+	const struct host_command_stats *st;
+	int i;
+
+	if (argc > 1) {
+		if (strcasecmp(argv[1], "reset"))
+			return EC_ERROR_PARAM1;
+		host_command_stats_reset();
+		return EC_SUCCESS;
+	}
+
+	ccputs("Cmd       Calls  Errors  InProg  Min(us)  Max(us)  Avg(us)\n");
+	for (cmd = __hcmds; cmd < __hcmds_end; cmd++) {
+		st = cmd->stats;
+		if (!st->calls)
+			continue;
+		ccprintf("0x%02x %10d %7d %7d %8d %8d %8d\n", cmd->command,
+			 st->calls, st->errors, st->in_progress, st->min_us,
+			 st->max_us, host_command_stats_avg(st));
+		cflush();
+	}
+
+	ccputs("Execution time histogram:\n");
+	for (i = 0; i < EC_HCSTATS_HISTOGRAM_BUCKETS - 1; i++)
+		ccprintf("  < %6d us %10d\n", 1 << i, hcstats_histogram[i]);
+	ccprintf(" >= %6d us %10d\n", 1 << (i - 1), hcstats_histogram[i]);
+
+	return EC_SUCCESS;
+}
+DECLARE_CONSOLE_COMMAND(hcstats, command_hcstats,
+			"[reset]",
+			"Print or reset host command statistics",
+			NULL);
+#endif
@@ -11,7 +11,7 @@
 #include "port80.h"
 #include "util.h"
 
-#define CPRINTF(format, args...) cprintf(CC_PORT80, format, ## args)
+#define CPRINTF(format, args...) cprintf_deferred(CC_PORT80, format, ## args)
 
 #define HISTORY_LEN 256
 
@@ -24,8 +24,9 @@ static int print_in_int = 1;
 void port_80_write(int data)
 {
 	/*
-	 * Note that this currently prints from inside the LPC interrupt
-	 * itself.  If you're dropping events, turn print_in_int off.
+	 * Note that this prints from inside the LPC interrupt itself, though
+	 * with CONFIG_CONSOLE_DEFERRED only the parameters are saved here.
+	 * If you're dropping events, turn print_in_int off.
 	 */
 	if (print_in_int)
 		CPRINTF("%c[%T Port 80: 0x%02x]", scroll ? '\n' : '\r', data);
@@ -25,8 +25,40 @@ static int hexdigit(int c)
 	return c > 9 ? (c + 'a' - 10) : (c + '0');
 }
 
-int vfnprintf(int (*addchar)(void *context, int c), void *context,
-	      const char *format, va_list args)
+/* Number of packed argument words holding a 64-bit value */
+#define U64_WORDS (sizeof(uint64_t) / sizeof(uintptr_t))
+
+/* Source of arguments for a format string */
+struct printf_args {
+	/* Packed arguments, or NULL to take them from va */
+	const uintptr_t *words;
+	va_list va;
+};
+
+static uint32_t next_u32(struct printf_args *a)
+{
+	return a->words ? (uint32_t)*a->words++ : va_arg(a->va, uint32_t);
+}
+
+static uint64_t next_u64(struct printf_args *a)
+{
+	uint64_t v;
+
+	if (!a->words)
+		return va_arg(a->va, uint64_t);
+
+	memcpy(&v, a->words, sizeof(v));
+	a->words += U64_WORDS;
+	return v;
+}
+
+static char *next_ptr(struct printf_args *a)
+{
+	return a->words ? (char *)*a->words++ : va_arg(a->va, char *);
+}
+
+static int format_args(int (*addchar)(void *context, int c), void *context,
+		       const char *format, struct printf_args *args)
 {
 	/*
 	 * Longest uint64 in decimal = 20
@@ -61,7 +93,7 @@ int vfnprintf(int (*addchar)(void *context, int c), void *context,
 
 		/* Handle %c */
 		if (c == 'c') {
-			c = va_arg(args, int);
+			c = next_u32(args);
 			dropped_chars |= addchar(context, c);
 			continue;
 		}
@@ -79,7 +111,7 @@ int vfnprintf(int (*addchar)(void *context, int c), void *context,
 		/* Count padding length */
 		pad_width = 0;
 		if (c == '*') {
-			pad_width = va_arg(args, int);
+			pad_width = next_u32(args);
 			c = *format++;
 		} else {
 			while (c >= '0' && c <= '9') {
@@ -98,7 +130,7 @@ int vfnprintf(int (*addchar)(void *context, int c), void *context,
 		if (c == '.') {
 			c = *format++;
 			if (c == '*') {
-				precision = va_arg(args, int);
+				precision = next_u32(args);
 				c = *format++;
 			} else {
 				while (c >= '0' && c <= '9') {
@@ -114,12 +146,12 @@ int vfnprintf(int (*addchar)(void *context, int c), void *context,
 		}
 
 		if (c == 's') {
-			vstr = va_arg(args, char *);
+			vstr = next_ptr(args);
 			if (vstr == NULL)
 				vstr = "(NULL)";
 		} else if (c == 'h') {
 			/* Hex dump output */
-			vstr = va_arg(args, char *);
+			vstr = next_ptr(args);
 
 			if (!precision) {
 				/* Hex dump requires precision */
@@ -151,13 +183,17 @@ int vfnprintf(int (*addchar)(void *context, int c), void *context,
 
 			/* Special-case: %T = current time */
 			if (c == 'T') {
-				v = get_time().val;
+				/* Packed arguments hold the time when packed */
+				if (args->words)
+					v = next_u64(args);
+				else
+					v = get_time().val;
 				is_64bit = 1;
 				precision = 6;
 			} else if (is_64bit) {
-				v = va_arg(args, uint64_t);
+				v = next_u64(args);
 			} else {
-				v = va_arg(args, uint32_t);
+				v = next_u32(args);
 			}
 
 			switch (c) {
@@ -266,6 +302,105 @@ int vfnprintf(int (*addchar)(void *context, int c), void *context,
 	return dropped_chars ? EC_ERROR_OVERFLOW : EC_SUCCESS;
 }
 
+int vfnprintf(int (*addchar)(void *context, int c), void *context,
+	      const char *format, va_list args)
+{
+	struct printf_args a;
+	int rv;
+
+	a.words = NULL;
+	va_copy(a.va, args);
+	rv = format_args(addchar, context, format, &a);
+	va_end(a.va);
+
+	return rv;
+}
+
+int vfnprintf_packed(int (*addchar)(void *context, int c), void *context,
+		     const char *format, const uintptr_t *args)
+{
+	struct printf_args a;
+
+	a.words = args;
+	return format_args(addchar, context, format, &a);
+}
+
+int printf_pack_args(uintptr_t *words, int max_words, const char *format,
+		     va_list args)
+{
+	uint64_t v;
+	int n = 0;
+	int c;
+
+	/*
+	 * Walk the format the same way format_args() does, but only to find
+	 * the arguments it will consume.
+	 */
+	while (*format) {
+		if (*format++ != '%')
+			continue;
+
+		c = *format++;
+		if (c == '%' || c == '\0') {
+			if (!c)
+				break;
+			continue;
+		}
+
+		/* Flags */
+		if (c == '-')
+			c = *format++;
+		if (c == '0')
+			c = *format++;
+
+		/* Width and precision, either of which may be an argument */
+		if (c == '*') {
+			if (n >= max_words)
+				return -1;
+			words[n++] = va_arg(args, int);
+			c = *format++;
+		}
+		while (c >= '0' && c <= '9')
+			c = *format++;
+		if (c == '.') {
+			c = *format++;
+			if (c == '*') {
+				if (n >= max_words)
+					return -1;
+				words[n++] = va_arg(args, int);
+				c = *format++;
+			}
+			while (c >= '0' && c <= '9')
+				c = *format++;
+		}
+
+		if (c == 'l' || c == 'T') {
+			if (c == 'l') {
+				v = va_arg(args, uint64_t);
+				c = *format++;
+			} else {
+				v = get_time().val;
+			}
+			if (n + U64_WORDS > max_words)
+				return -1;
+			memcpy(words + n, &v, sizeof(v));
+			n += U64_WORDS;
+		} else if (c == 's' || c == 'h') {
+			if (n >= max_words)
+				return -1;
+			words[n++] = (uintptr_t)va_arg(args, char *);
+		} else if (c) {
+			if (n >= max_words)
+				return -1;
+			words[n++] = va_arg(args, uint32_t);
+		} else {
+			break;
+		}
+	}
+
+	return n;
+}
+
 /* Context for snprintf() */
 struct snprintf_context {
 	char *str;
@@ -123,6 +123,103 @@ void SHA256_init(struct sha256_ctx *ctx)
 	ctx->tot_len = 0;
 }
 
+/*
+ * Load the 16 big-endian message words of a block.  Word-aligned blocks
+ * (which is all of them when hashing flash a chunk at a time) are loaded a
+ * word at a time and byte-swapped, which compiles to a single rev (ARMv7-M)
+ * or bswap (x86) instruction per word.
+ */
+static inline void SHA256_load(uint32_t *w, const uint8_t *sub_block)
+{
+	int j;
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	if (!((uintptr_t)sub_block & 3)) {
+		const uint32_t *p = (const uint32_t *)sub_block;
+
+		for (j = 0; j < 16; j++)
+			w[j] = __builtin_bswap32(p[j]);
+		return;
+	}
+#endif
+
+	for (j = 0; j < 16; j++)
+		PACK32(&sub_block[j << 2], &w[j]);
+}
+
+#ifdef CONFIG_SHA256_UNROLL
+
+/*
+ * Message schedule word i >= 16, computed in place in a 16-word circular
+ * buffer.
+ */
+#define SHA256_SCHED(i)							\
+	(w[(i) & 15] += SHA256_F4(w[((i) - 2) & 15]) + w[((i) - 7) & 15]	\
+			+ SHA256_F3(w[((i) - 15) & 15]))
+
+/*
+ * One round.  Instead of shifting the working variables along, the caller
+ * rotates which variable plays which role.
+ */
+#define SHA256_RND(a, b, c, d, e, f, g, h, i, wi)			\
+	{								\
+		t1 = h + SHA256_F2(e) + CH(e, f, g) + sha256_k[i] + (wi);\
+		d += t1;						\
+		h = t1 + SHA256_F1(a) + MAJ(a, b, c);			\
+	}
+
+#define SHA256_RND8(j, W)						\
+	{								\
+		SHA256_RND(a, b, c, d, e, f, g, h, (j) + 0, W((j) + 0));	\
+		SHA256_RND(h, a, b, c, d, e, f, g, (j) + 1, W((j) + 1));	\
+		SHA256_RND(g, h, a, b, c, d, e, f, (j) + 2, W((j) + 2));	\
+		SHA256_RND(f, g, h, a, b, c, d, e, (j) + 3, W((j) + 3));	\
+		SHA256_RND(e, f, g, h, a, b, c, d, (j) + 4, W((j) + 4));	\
+		SHA256_RND(d, e, f, g, h, a, b, c, (j) + 5, W((j) + 5));	\
+		SHA256_RND(c, d, e, f, g, h, a, b, (j) + 6, W((j) + 6));	\
+		SHA256_RND(b, c, d, e, f, g, h, a, (j) + 7, W((j) + 7));	\
+	}
+
+#define SHA256_MSG(i) w[i]
+
+static void SHA256_transform(struct sha256_ctx *ctx, const uint8_t *message,
+			     unsigned int block_nb)
+{
+	uint32_t w[16];
+	uint32_t a, b, c, d, e, f, g, h;
+	uint32_t t1;
+	int i, j;
+
+	for (i = 0; i < (int) block_nb; i++) {
+		SHA256_load(w, message + (i << 6));
+
+		a = ctx->h[0];
+		b = ctx->h[1];
+		c = ctx->h[2];
+		d = ctx->h[3];
+		e = ctx->h[4];
+		f = ctx->h[5];
+		g = ctx->h[6];
+		h = ctx->h[7];
+
+		for (j = 0; j < 16; j += 8)
+			SHA256_RND8(j, SHA256_MSG);
+		for (j = 16; j < 64; j += 8)
+			SHA256_RND8(j, SHA256_SCHED);
+
+		ctx->h[0] += a;
+		ctx->h[1] += b;
+		ctx->h[2] += c;
+		ctx->h[3] += d;
+		ctx->h[4] += e;
+		ctx->h[5] += f;
+		ctx->h[6] += g;
+		ctx->h[7] += h;
+	}
+}
+
+#else  /* !CONFIG_SHA256_UNROLL */
+
 static void SHA256_transform(struct sha256_ctx *ctx, const uint8_t *message,
 			     unsigned int block_nb)
 {
@@ -130,14 +227,10 @@ static void SHA256_transform(struct sha256_ctx *ctx, const uint8_t *message,
 	uint32_t w[64];
 	uint32_t wv[8];
 	uint32_t t1, t2;
-	const unsigned char *sub_block;
 	int i, j;
 
 	for (i = 0; i < (int) block_nb; i++) {
-		sub_block = message + (i << 6);
-
-		for (j = 0; j < 16; j++)
-			PACK32(&sub_block[j << 2], &w[j]);
+		SHA256_load(w, message + (i << 6));
 
 		for (j = 16; j < 64; j++)
 			SHA256_SCR(j);
@@ -164,6 +257,8 @@ static void SHA256_transform(struct sha256_ctx *ctx, const uint8_t *message,
 	}
 }
 
+#endif  /* CONFIG_SHA256_UNROLL */
+
 void SHA256_update(struct sha256_ctx *ctx, const uint8_t *data, uint32_t len)
 {
 	unsigned int block_nb;
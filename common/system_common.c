@@ -238,16 +238,19 @@ int system_get_image_used(enum system_image_copy_t copy)
 	int size = 0;
 
 	if (copy == SYSTEM_IMAGE_RO) {
-		image = (const uint8_t *)CONFIG_FW_RO_OFF;
+		image = (const uint8_t *)(CONFIG_FLASH_BASE + CONFIG_FW_RO_OFF);
 		size = CONFIG_FW_RO_SIZE;
 	} else if (copy == SYSTEM_IMAGE_RW) {
-		image = (const uint8_t *)CONFIG_FW_RW_OFF;
+		image = (const uint8_t *)(CONFIG_FLASH_BASE + CONFIG_FW_RW_OFF);
 		size = CONFIG_FW_RW_SIZE;
 	}
 
 	if (size <= 0)
 		return 0;
 
+	/* The image is read directly, so make sure buffered writes landed */
+	flash_write_flush();
+
 	/*
 	 * Scan backwards looking for 0xea byte, which is by definition the
 	 * last byte of the image.  See ec.lds.S for how this is inserted at
@@ -318,6 +321,9 @@ static void jump_to_image(uintptr_t init_addr)
 	if (uart_init_done())
 		uart_flush_output();
 
+	/* Program buffered flash writes while we can still take its lock */
+	flash_write_flush();
+
 	/* Disable interrupts before jump */
 	interrupt_disable();
 
@@ -339,7 +345,7 @@ static void jump_to_image(uintptr_t init_addr)
 /**
  * Return the base pointer for the image copy, or 0xffffffff if error.
  */
-static uint32_t get_base(enum system_image_copy_t copy)
+static uintptr_t get_base(enum system_image_copy_t copy)
 {
 	switch (copy) {
 	case SYSTEM_IMAGE_RO:
@@ -25,6 +25,9 @@
 #define TX_BUF_DIFF(i, j) (((i) - (j)) & (CONFIG_UART_TX_BUF_SIZE - 1))
 #define RX_BUF_DIFF(i, j) (((i) - (j)) & (CONFIG_UART_RX_BUF_SIZE - 1))
 
+/* Macro to wrap an index into the transmit buffer */
+#define TX_BUF_WRAP(i) ((i) & (CONFIG_UART_TX_BUF_SIZE - 1))
+
 /* ASCII control character; for example, CTRL('C') = ^C */
 #define CTRL(c) ((c) - '@')
 
@@ -37,6 +40,15 @@ static volatile int rx_buf_head;
 static volatile int rx_buf_tail;
 static int tx_snapshot_head;
 static int tx_snapshot_tail;
+/*
+ * Sequence number of the next byte written to tx_buf, and sequence number
+ * past the last byte a writer may be changing.  Sequence numbers let
+ * EC_CMD_CONSOLE_READ v1 find output which has already been transmitted.
+ */
+static volatile uint32_t tx_buf_seq;
+static volatile uint32_t tx_buf_seq_reserved;
+/* Number of bytes dropped because the transmit buffer was full */
+static volatile uint32_t tx_buf_dropped;
 static int uart_suspended;
 
 /**
@@ -53,18 +65,127 @@ static int __tx_char(void *context, int c)
 	int tx_buf_next;
 
 	/* Do newline to CRLF translation */
-	if (c == '\n' && __tx_char(NULL, '\r'))
+	if (c == '\n' && __tx_char(NULL, '\r')) {
+		tx_buf_dropped++;
 		return 1;
+	}
 
 	tx_buf_next = TX_BUF_NEXT(tx_buf_head);
-	if (tx_buf_next == tx_buf_tail)
+	if (tx_buf_next == tx_buf_tail) {
+		tx_buf_dropped++;
 		return 1;
+	}
 
+	tx_buf_seq_reserved = tx_buf_seq + 1;
 	tx_buf[tx_buf_head] = c;
 	tx_buf_head = tx_buf_next;
+	tx_buf_seq++;
 	return 0;
 }
 
+/**
+ * Put a string into the transmit buffer.
+ *
+ * Equivalent to calling __tx_char() for each character, but copies runs of
+ * characters up to the next newline or the end of the buffer at a time.
+ *
+ * Each run is copied with interrupts disabled, so that output from an
+ * interrupt or a higher-priority task can't be written at the same head and
+ * then overwritten.  A run is at most the size of the buffer.
+ *
+ * Does not enable the transmit interrupt; assumes that happens elsewhere.
+ *
+ * @param outstr	String to write.
+ * @return 0 if the whole string was buffered, 1 if some was dropped.
+ */
+static int tx_puts(const char *outstr)
+{
+	int head, space, limit, n;
+
+	while (*outstr) {
+		interrupt_disable();
+
+		head = tx_buf_head;
+		space = TX_BUF_DIFF(tx_buf_tail, head + 1);
+
+		if (*outstr == '\n') {
+			/* Do newline to CRLF translation */
+			if (space < 2) {
+				interrupt_enable();
+				break;
+			}
+			tx_buf_seq_reserved = tx_buf_seq + 2;
+			tx_buf[head] = '\r';
+			tx_buf[TX_BUF_NEXT(head)] = '\n';
+			n = 2;
+			outstr++;
+		} else {
+			/* Copy up to a newline, the buffer end, or no space */
+			limit = MIN(space, CONFIG_UART_TX_BUF_SIZE - head);
+			for (n = 0; n < limit && outstr[n] && outstr[n] != '\n';
+			     n++)
+				;
+			if (!n) {
+				interrupt_enable();
+				break;
+			}
+			tx_buf_seq_reserved = tx_buf_seq + n;
+			memcpy((char *)tx_buf + head, outstr, n);
+			outstr += n;
+		}
+
+		tx_buf_head = TX_BUF_WRAP(head + n);
+		tx_buf_seq += n;
+
+		interrupt_enable();
+	}
+
+	if (!*outstr)
+		return 0;
+
+	/* Count what didn't fit, as __tx_char() would */
+	for (n = 0; *outstr; outstr++)
+		n += (*outstr == '\n') ? 2 : 1;
+	tx_buf_dropped += n;
+	return 1;
+}
+
+#ifdef CONFIG_UART_TX_DMA
+/* Number of bytes at tx_buf_tail which are being sent by DMA */
+static volatile int tx_dma_in_progress;
+
+/**
+ * Hand the next contiguous span of the output buffer to DMA.
+ *
+ * Bytes stay in the output buffer until their transfer completes, so they
+ * can't be overwritten while DMA is still reading them.  Does nothing if a
+ * transfer is still running.
+ *
+ * May be called from interrupt context.
+ */
+static void fill_tx_fifo(void)
+{
+	int head = tx_buf_head;
+
+	if (!uart_tx_dma_ready())
+		return;
+
+	/* Free the span sent by the previous transfer */
+	if (tx_dma_in_progress) {
+		tx_buf_tail = TX_BUF_WRAP(tx_buf_tail + tx_dma_in_progress);
+		tx_dma_in_progress = 0;
+	}
+
+	if (head == tx_buf_tail)
+		return;
+
+	/* Send up to the head, or to the end of the buffer if it wraps */
+	tx_dma_in_progress = (head > tx_buf_tail ?
+			      head : CONFIG_UART_TX_BUF_SIZE) - tx_buf_tail;
+	uart_tx_dma_start((const char *)tx_buf + tx_buf_tail,
+			  tx_dma_in_progress);
+}
+#else
 /**
  * Copy output from buffer until TX fifo full or output buffer empty.
  *
@@ -77,6 +198,7 @@ static void fill_tx_fifo(void)
 		tx_buf_tail = TX_BUF_NEXT(tx_buf_tail);
 	}
 }
+#endif
 
 /**
  * Helper for UART processing.
@@ -134,17 +256,16 @@ int uart_putc(int c)
 
 int uart_puts(const char *outstr)
 {
+	int rv;
+
 	/* Put all characters in the output buffer */
-	while (*outstr) {
-		if (__tx_char(NULL, *outstr++) != 0)
-			break;
-	}
+	rv = tx_puts(outstr);
 
 	if (!uart_suspended && uart_tx_stopped())
 		uart_tx_start();
 
 	/* Successful if we consumed all output */
-	return *outstr ? EC_ERROR_OVERFLOW : EC_SUCCESS;
+	return rv ? EC_ERROR_OVERFLOW : EC_SUCCESS;
 }
 
 int uart_vprintf(const char *format, va_list args)
@@ -157,6 +278,16 @@ int uart_vprintf(const char *format, va_list args)
 	return rv;
 }
 
+int uart_printf_packed(const char *format, const uintptr_t *args)
+{
+	int rv = vfnprintf_packed(__tx_char, NULL, format, args);
+
+	if (!uart_suspended && uart_tx_stopped())
+		uart_tx_start();
+
+	return rv;
+}
+
 int uart_printf(const char *format, ...)
 {
 	int rv;
@@ -251,6 +382,12 @@ int uart_buffer_empty(void)
 	return tx_buf_head == tx_buf_tail;
 }
 
+void uart_get_tx_stats(uint32_t *written, uint32_t *dropped)
+{
+	*written = tx_buf_seq;
+	*dropped = tx_buf_dropped;
+}
+
 int uart_gets(char *dest, int size)
 {
 	int got = 0;
@@ -316,6 +453,76 @@ DECLARE_HOST_COMMAND(EC_CMD_CONSOLE_SNAPSHOT,
 		     host_command_console_snapshot,
 		     EC_VER_MASK(0));
 
+/**
+ * Read whole lines of console output by sequence number.
+ */
+static int console_read_seq(struct host_cmd_handler_args *args)
+{
+	const struct ec_params_console_read_v1 *p = args->params;
+	struct ec_response_console_read_v1 *r = args->response;
+	uint32_t seq = p->seq;
+	uint32_t end = tx_buf_seq;
+	int max = args->response_max - sizeof(*r) - 1;
+	int lost = 0;
+	int size, skip, len, i;
+
+	if (max <= 0)
+		return EC_RES_INVALID_PARAM;
+
+	/*
+	 * Start at the oldest byte still in the buffer if the requested
+	 * output has been overwritten.  This also catches a sequence number
+	 * from before the EC rebooted.
+	 */
+	if (end - seq > CONFIG_UART_TX_BUF_SIZE - 1) {
+		if (end > CONFIG_UART_TX_BUF_SIZE - 1) {
+			seq = end - (CONFIG_UART_TX_BUF_SIZE - 1);
+			lost = 1;
+		} else {
+			/* Nothing has been overwritten yet */
+			seq = 0;
+		}
+	}
+
+	/* Copy the output, then drop anything overwritten while copying */
+	size = MIN((int)(end - seq), max);
+	i = TX_BUF_WRAP(seq);
+	len = MIN(size, CONFIG_UART_TX_BUF_SIZE - i);
+	memcpy(r->data, (const char *)tx_buf + i, len);
+	memcpy(r->data + len, (const char *)tx_buf, size - len);
+
+	skip = (int32_t)(tx_buf_seq_reserved - CONFIG_UART_TX_BUF_SIZE - seq);
+	if (skip > 0)
+		lost = 1;
+	else
+		skip = 0;
+
+	/* After lost output, start at the next whole line */
+	if (lost) {
+		for (i = skip; i < size && r->data[i] != '\n'; i++)
+			;
+		if (i < size)
+			skip = i + 1;
+	}
+	skip = MIN(skip, size);
+
+	/* End after the last whole line, unless a single line doesn't fit */
+	for (len = size; len > skip && r->data[len - 1] != '\n'; len--)
+		;
+	if (len == skip && size == max)
+		len = size;
+
+	r->seq = seq + skip;
+	r->next_seq = seq + len;
+
+	len -= skip;
+	memmove(r->data, r->data + skip, len);
+	r->data[len] = '\0';
+	args->response_size = sizeof(*r) + len + 1;
+
+	return EC_RES_SUCCESS;
+}
+
 static int host_command_console_read(struct host_cmd_handler_args *args)
 {
 	char *dest = (char *)args->response;
@@ -327,6 +534,9 @@ static int host_command_console_read(struct host_cmd_handler_args *args)
 	if (system_is_locked())
 		return EC_ERROR_ACCESS_DENIED;
 
+	if (args->version == 1)
+		return console_read_seq(args);
+
 	/* If no snapshot data, return empty response */
 	if (tx_snapshot_head == tx_snapshot_tail)
 		return EC_RES_SUCCESS;
@@ -355,4 +565,4 @@ static int host_command_console_read(struct host_cmd_handler_args *args)
 }
 DECLARE_HOST_COMMAND(EC_CMD_CONSOLE_READ,
 		     host_command_console_read,
-		     EC_VER_MASK(0));
+		     EC_VER_MASK(0) | EC_VER_MASK(1));
@@ -7,6 +7,7 @@
 
 #include "common.h"
 #include "console.h"
+#include "flash.h"
 #include "hooks.h"
 #include "host_command.h"
 #include "sha256.h"
@@ -28,17 +29,109 @@ struct vboot_hash_tag {
 
 #define VBOOT_HASH_SYSJUMP_TAG 0x5648 /* "VH" */
 #define VBOOT_HASH_SYSJUMP_VERSION 1
-#define CHUNK_SIZE 1024
+
+/*
+ * Data is hashed a chunk at a time.  The chunk size doubles while no other
+ * task is waiting to run, and halves when one is.
+ */
+#define CHUNK_SIZE_MIN 1024
+#define CHUNK_SIZE_MAX (8 * 1024)
+
+/* Time to sleep between chunks when other tasks are waiting to run */
+#define WORK_INTERVAL_US 100
+
+/*
+ * Maximum number of checkpoints.  Hash state is saved at checkpoints spaced
+ * a whole number of erase blocks apart, so that after a flash write or erase
+ * the hash only needs to be recomputed from the last checkpoint before the
+ * modified data.
+ */
+#define CHECKPOINT_COUNT 32
+
+BUILD_ASSERT(CONFIG_FLASH_ERASE_SIZE % SHA256_BLOCK_SIZE == 0);
 
 static uint32_t data_offset;
 static uint32_t data_size;
 static uint32_t curr_pos;
+static uint32_t start_pos;    /* Position hashing started or resumed from */
+static uint32_t chunk_size;
+static timestamp_t hash_start_time;
+static uint32_t hash_time_us; /* Time taken by last completed hash */
 static const uint8_t *hash;   /* Hash, or NULL if not valid */
 static int want_abort;
 static int in_progress;
 
 static struct sha256_ctx ctx;
 
+static uint32_t ckpt_offset;	/* Flash offset of checkpointed data */
+static uint32_t ckpt_size;	/* Size of checkpointed data */
+static uint32_t ckpt_spacing;	/* Bytes between checkpoints */
+static int ckpt_valid;		/* Number of valid checkpoints */
+static int ckpt_active;		/* Save checkpoints for current hash? */
+static uint32_t ckpt_state[CHECKPOINT_COUNT][8];
+
+/*
+ * Set up checkpoints for a hash of <size> bytes at flash offset <offset>, and
+ * resume the hash from the last valid checkpoint if there is one.
+ */
+static void checkpoint_restore(uint32_t offset, uint32_t size)
+{
+	ckpt_active = 1;
+
+	if (offset != ckpt_offset || size != ckpt_size) {
+		/* Different region, so start a new set of checkpoints */
+		ckpt_offset = offset;
+		ckpt_size = size;
+		ckpt_valid = 0;
+		ckpt_spacing = CONFIG_FLASH_ERASE_SIZE;
+		while (size / ckpt_spacing > CHECKPOINT_COUNT)
+			ckpt_spacing <<= 1;
+		return;
+	}
+
+	if (!ckpt_valid)
+		return;
+
+	/*
+	 * Checkpoints are on SHA-256 block boundaries, so the context has no
+	 * buffered data there and only the intermediate hash needs restoring.
+	 */
+	curr_pos = ckpt_valid * ckpt_spacing;
+	memcpy(ctx.h, ckpt_state[ckpt_valid - 1], sizeof(ctx.h));
+	ctx.tot_len = curr_pos;
+	CPRINTF("[%T hash resume 0x%08x]\n", offset + curr_pos);
+}
+
+/* Save a checkpoint if the hash has reached the next one */
+static void checkpoint_save(void)
+{
+	int n;
+
+	if (!ckpt_active || curr_pos % ckpt_spacing)
+		return;
+
+	/* Only extend the run of valid checkpoints from the start */
+	n = curr_pos / ckpt_spacing;
+	if (n != ckpt_valid + 1 || n > CHECKPOINT_COUNT)
+		return;
+
+	memcpy(ckpt_state[n - 1], ctx.h, sizeof(ctx.h));
+	ckpt_valid = n;
+}
+
+/* Discard checkpoints which depend on flash data at <offset>, <size> */
+static void checkpoint_invalidate(int offset, int size)
+{
+	int n;
+
+	if (offset + size <= ckpt_offset || offset >= ckpt_offset + ckpt_size)
+		return;
+
+	n = offset <= ckpt_offset ? 0 : (offset - ckpt_offset) / ckpt_spacing;
+	if (n < ckpt_valid)
+		ckpt_valid = n;
+}
+
 /*
  * Start computing a hash of <size> bytes of data at flash offset <offset>.
  * If nonce_size is non-zero, prefixes the <nonce> onto the data to be
@@ -71,8 +164,16 @@ static int vboot_hash_start(uint32_t offset, uint32_t size,
 	/* Restart the hash computation */
 	CPRINTF("[%T hash start 0x%08x 0x%08x]\n", offset, size);
 	SHA256_init(&ctx);
-	if (nonce_size)
+	if (nonce_size) {
+		/* Checkpoints don't apply to a hash with a nonce prefix */
+		ckpt_active = 0;
 		SHA256_update(&ctx, nonce, nonce_size);
+	} else {
+		checkpoint_restore(offset, size);
+	}
+	start_pos = curr_pos;
+	chunk_size = CHUNK_SIZE_MIN;
+	hash_start_time = get_time();
 
 	/* Wake the hash task */
 	task_wake(TASK_ID_VBOOTHASH);
@@ -124,6 +225,9 @@ int vboot_hash_invalidate(int offset, int size)
 	if (offset < 0 || size <= 0 || offset + size < 0)
 		return 0;
 
+	/* Checkpoints are kept across aborts, so always trim them */
+	checkpoint_invalidate(offset, size);
+
 	/* Don't invalidate if hash is already invalid */
 	if (!hash)
 		return 0;
@@ -138,6 +242,28 @@ int vboot_hash_invalidate(int offset, int size)
 	return 1;
 }
 
+/* Hash up to <size> more bytes of data, saving checkpoints along the way */
+static void hash_next_chunk(uint32_t size)
+{
+	const char *data;
+	uint32_t n;
+
+	size = MIN(size, data_size - curr_pos);
+	while (size) {
+		/* Stop at the next checkpoint */
+		n = size;
+		if (ckpt_active)
+			n = MIN(n, ckpt_spacing - curr_pos % ckpt_spacing);
+
+		/* Read through flash_dataptr() so buffered writes land first */
+		flash_dataptr(data_offset + curr_pos, n, 1, &data);
+		SHA256_update(&ctx, (const uint8_t *)data, n);
+		curr_pos += n;
+		size -= n;
+		checkpoint_save();
+	}
+}
+
 void vboot_hash_task(void)
 {
 	vboot_hash_init();
@@ -152,16 +278,12 @@ void vboot_hash_task(void)
 			vboot_hash_abort();
 		} else {
 			/* Compute the next chunk of hash */
-			int size = MIN(CHUNK_SIZE, data_size - curr_pos);
-
-			SHA256_update(&ctx,
-				      (const uint8_t *)(CONFIG_FLASH_BASE +
-							data_offset + curr_pos),
-				      size);
-			curr_pos += size;
+			hash_next_chunk(chunk_size);
 			if (curr_pos >= data_size) {
 				/* Store the final hash */
 				hash = SHA256_final(&ctx);
+				hash_time_us = get_time().val -
+					hash_start_time.val;
 				CPRINTF("[%T hash done %.*h]\n",
 					SHA256_DIGEST_SIZE, hash);
 
@@ -172,11 +294,14 @@ void vboot_hash_task(void)
 					vboot_hash_abort();
 			}
 
-			/*
-			 * Let other tasks (really, just the watchdog task)
-			 * run for a bit.
-			 */
-			usleep(100);
+			if (task_others_ready()) {
+				/* Back off and let other tasks run */
+				chunk_size = MAX(chunk_size / 2,
+						 CHUNK_SIZE_MIN);
+				usleep(WORK_INTERVAL_US);
+			} else if (chunk_size < CHUNK_SIZE_MAX) {
+				chunk_size *= 2;
+			}
 		}
 	}
 }
@@ -223,9 +348,11 @@ static int command_hash(int argc, char **argv)
 			ccprintf("(aborting)\n");
 		else if (in_progress)
 			ccprintf("(in progress)\n");
-		else if (hash)
+		else if (hash) {
 			ccprintf("%.*h\n", SHA256_DIGEST_SIZE, hash);
-		else
+			ccprintf("Hashed: %d bytes in %d us\n",
+				 data_size - start_pos, hash_time_us);
+		} else
 			ccprintf("(invalid)\n");
 
 		return EC_SUCCESS;
@@ -278,7 +405,7 @@ DECLARE_CONSOLE_COMMAND(hash, command_hash,
 /* Host commands */
 
 /* Fill in the response with the current hash status */
-static void fill_response(struct ec_response_vboot_hash *r)
+static void fill_response(struct ec_response_vboot_hash_1 *r)
 {
 	if (in_progress)
 		r->status = EC_VBOOT_HASH_STATUS_BUSY;
@@ -291,10 +418,21 @@ static void fill_response(struct ec_response_vboot_hash *r)
 		r->size = data_size;
 		ASSERT(SHA256_DIGEST_SIZE < sizeof(r->hash_digest));
 		memcpy(r->hash_digest, hash, SHA256_DIGEST_SIZE);
+		r->hashed_size = data_size - start_pos;
+		r->hash_time_us = hash_time_us;
 	} else
 		r->status = EC_VBOOT_HASH_STATUS_NONE;
 }
 
+/* Size of the response for the command version being handled */
+static int response_size(const struct host_cmd_handler_args *args)
+{
+	if (args->version == 0)
+		return sizeof(struct ec_response_vboot_hash);
+	else
+		return sizeof(struct ec_response_vboot_hash_1);
+}
+
 /**
  * Start computing a hash, with sanity checking on params.
  *
@@ -331,16 +469,20 @@ static int host_start_hash(const struct ec_params_vboot_hash *p)
 		return EC_RES_ERROR;
 }
 
+/* Version 2 recalc sends its response after an in-progress response */
+BUILD_ASSERT(sizeof(struct ec_response_vboot_hash_1) <=
+	     HOST_ASYNC_RESPONSE_MAX);
+
 static int host_command_vboot_hash(struct host_cmd_handler_args *args)
 {
 	const struct ec_params_vboot_hash *p = args->params;
-	struct ec_response_vboot_hash *r = args->response;
+	struct ec_response_vboot_hash_1 *r = args->response;
 	int rv;
 
 	switch (p->cmd) {
 	case EC_VBOOT_HASH_GET:
 		fill_response(r);
-		args->response_size = sizeof(*r);
+		args->response_size = response_size(args);
 		return EC_RES_SUCCESS;
 
 	case EC_VBOOT_HASH_ABORT:
@@ -355,12 +497,19 @@ static int host_command_vboot_hash(struct host_cmd_handler_args *args)
 		if (rv != EC_RES_SUCCESS)
 			return rv;
 
-		/* Wait for hash to finish */
+		/*
+		 * Version 2 hosts know to poll for the result, so let them go
+		 * while we wait for the hash to finish.
+		 */
+		if (args->version >= 2) {
+			args = host_command_in_progress(args);
+			r = args->response;
+		}
 		while (in_progress)
 			usleep(1000);
 
 		fill_response(r);
-		args->response_size = sizeof(*r);
+		args->response_size = response_size(args);
 		return EC_RES_SUCCESS;
 
 	default:
@@ -369,4 +518,4 @@ static int host_command_vboot_hash(struct host_cmd_handler_args *args)
 }
 DECLARE_HOST_COMMAND(EC_CMD_VBOOT_HASH,
 		     host_command_vboot_hash,
-		     EC_VER_MASK(0));
+		     EC_VER_MASK(0) | EC_VER_MASK(1) | EC_VER_MASK(2));
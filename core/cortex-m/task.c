@@ -190,6 +190,12 @@ task_id_t task_get_current(void)
 	return current_task - tasks;
 }
 
+int task_others_ready(void)
+{
+	return (tasks_ready & ~(1 << task_get_current()) &
+		~(1 << TASK_ID_IDLE)) != 0;
+}
+
 uint32_t *task_get_event_bitmap(task_id_t tskid)
 {
 	task_ *tsk = __task_id_to_ptr(tskid);
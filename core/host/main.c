@@ -31,6 +31,7 @@ int main(int argc, char **argv)
 
 	register_test_end_hook();
 
+	task_pre_init();
 	flash_pre_init();
 	system_pre_init();
 	system_common_pre_init();
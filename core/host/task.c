@@ -8,17 +8,41 @@
 #include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <ucontext.h>
 
 #include "atomic.h"
 #include "common.h"
+#include "console.h"
+#include "link_defs.h"
 #include "task.h"
 #include "task_id.h"
 #include "test_util.h"
 #include "timer.h"
+#include "util.h"
 
+/*
+ * Stack size for emulated tasks. Tasks call into the C library (stdio in
+ * particular), so this needs to be much larger than TASK_STACK_SIZE.
+ */
+#define EMU_TASK_STACK_SIZE (64 * 1024)
+
+/*
+ * Virtual time charged for each context switch, so that code which expects
+ * time to pass while tasks run (e.g. strict deadline comparisons) still makes
+ * progress.
+ */
+#define EMU_CONTEXT_SWITCH_US 1
+
+/*
+ * All tasks run as coroutines on a single OS thread. The scheduler lives on
+ * the stack of main(). With CONFIG_EMU_VIRTUAL_TIME it fast-forwards the
+ * system time whenever all tasks are waiting, so a test run does not depend
+ * on the host load; otherwise it sleeps until the next wake deadline.
+ */
 struct emu_task_t {
-	pthread_t thread;
-	pthread_cond_t resume;
+	ucontext_t context;
 	uint32_t event;
 	timestamp_t wake_time;
 };
@@ -29,10 +53,72 @@ struct task_args {
 };
 
 static struct emu_task_t tasks[TASK_ID_COUNT];
-static pthread_cond_t scheduler_cond;
-static pthread_mutex_t run_lock;
+static ucontext_t scheduler_context;
+static task_id_t running_task_id;
+static int start_called;  /* Has task swapping started */
+static int in_scheduler;  /* Running on the scheduler context */
 
-static __thread task_id_t my_task_id; /* thread local task id */
+/* Sanity check about static task invariants */
+BUILD_ASSERT(TASK_ID_COUNT <= sizeof(uint32_t) * 8);
+
+/*
+ * Bitmap of tasks ready to be run, i.e. tasks with pending events or an
+ * expired timer.
+ */
+static uint32_t tasks_ready;
+
+/*
+ * Binary min-heap of tasks with a pending wake-up timer, ordered by wake time.
+ * timer_heap_pos[] maps a task ID to its slot in the heap, or TIMER_HEAP_NONE
+ * if the task has no timer armed.
+ */
+#define TIMER_HEAP_NONE 0xff
+static task_id_t timer_heap[TASK_ID_COUNT];
+static uint8_t timer_heap_pos[TASK_ID_COUNT];
+static int timer_heap_size;
+
+/*
+ * Events may also be set from threads other than the emulator thread (e.g.
+ * the console input monitor). When no task is ready and no timer is pending,
+ * the scheduler blocks until one of those threads sets an event.
+ */
+static pthread_t emu_thread;
+static pthread_mutex_t external_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t external_cond = PTHREAD_COND_INITIALIZER;
+
+/*
+ * Emulated interrupt controller. Like the NVIC, each IRQ has an enable and a
+ * pending bit, and a lower priority value means a higher priority. Since all
+ * tasks share one OS thread, pending interrupts are taken when they are
+ * triggered from the emulator thread, when they get unmasked, and whenever
+ * the scheduler runs. Interrupts triggered by other threads are taken at the
+ * next of those points.
+ */
+BUILD_ASSERT(CONFIG_IRQ_COUNT <= sizeof(uint32_t) * 8);
+
+#define IRQ_PRIO_NONE 0xff
+static uint32_t irq_enabled;
+static uint32_t irq_pending;
+static uint8_t irq_prio[CONFIG_IRQ_COUNT];
+static uint8_t irq_running_prio = IRQ_PRIO_NONE;
+static int irq_running = -1;
+static int interrupt_disabled;
+
+#ifdef CONFIG_TASK_PROFILING
+static uint32_t irq_dist[CONFIG_IRQ_COUNT];  /* Distribution of IRQ calls */
+#endif
+
+/* Handlers declared with DECLARE_IRQ(); unused vectors are left NULL. */
+#define IRQ_VECTOR(n) void irq_##n##_handler(void) __attribute__((weak));
+IRQ_VECTOR(0) IRQ_VECTOR(1) IRQ_VECTOR(2) IRQ_VECTOR(3)
+IRQ_VECTOR(4) IRQ_VECTOR(5) IRQ_VECTOR(6) IRQ_VECTOR(7)
+#undef IRQ_VECTOR
+
+static void (* const irq_vectors[])(void) = {
+	irq_0_handler, irq_1_handler, irq_2_handler, irq_3_handler,
+	irq_4_handler, irq_5_handler, irq_6_handler, irq_7_handler,
+};
+BUILD_ASSERT(ARRAY_SIZE(irq_vectors) == CONFIG_IRQ_COUNT);
 
 #define TASK(n, r, d, s) void r(void *);
 CONFIG_TASK_LIST
@@ -69,45 +155,259 @@ static const char * const task_names[] = {
 };
 #undef TASK
 
+static int is_emu_thread(void)
+{
+	return pthread_equal(pthread_self(), emu_thread);
+}
+
+static void wake_scheduler(void)
+{
+	pthread_mutex_lock(&external_lock);
+	pthread_cond_signal(&external_cond);
+	pthread_mutex_unlock(&external_lock);
+}
+
+/**
+ * Return the highest priority IRQ which may preempt the current context, or
+ * -1 if there is none.
+ */
+static int irq_get_next(void)
+{
+	uint32_t deliverable = irq_pending & irq_enabled;
+	int best = -1;
+	int i;
+
+	if (interrupt_disabled)
+		return -1;
+
+	for (i = 0; deliverable; ++i, deliverable >>= 1)
+		if ((deliverable & 1) && irq_prio[i] < irq_running_prio &&
+		    (best < 0 || irq_prio[i] < irq_prio[best]))
+			best = i;
+
+	return best;
+}
+
+/* Run handlers for all deliverable IRQs, nesting by priority. */
+static void irq_dispatch(void)
+{
+	uint8_t prev_prio = irq_running_prio;
+	int prev_irq = irq_running;
+	int irq;
+
+	while ((irq = irq_get_next()) >= 0) {
+		atomic_clear(&irq_pending, 1 << irq);
+		irq_running_prio = irq_prio[irq];
+		irq_running = irq;
+		if (irq_vectors[irq])
+			irq_vectors[irq]();
+		irq_running_prio = prev_prio;
+		irq_running = prev_irq;
+	}
+}
+
+/**
+ * Yield to the scheduler if an interrupt handler made a higher priority task
+ * ready. The current task stays ready, so it resumes once it is again the
+ * highest priority ready task.
+ */
+static void task_preempt_if_needed(void)
+{
+	task_id_t me = task_get_current();
+
+	if (!start_called || in_scheduler || in_interrupt_context())
+		return;
+
+	if (!(tasks_ready & ~((2u << me) - 1)))
+		return;
+
+	atomic_or(&tasks_ready, 1 << me);
+	swapcontext(&tasks[me].context, &scheduler_context);
+
+	/* Keep the ready bit only if events arrived while preempted */
+	atomic_clear(&tasks_ready, 1 << me);
+	if (tasks[me].event)
+		atomic_or(&tasks_ready, 1 << me);
+}
+
+/* Take pending interrupts now if running on the emulator thread. */
+static void irq_check_pending(void)
+{
+	if (!is_emu_thread()) {
+		wake_scheduler();
+		return;
+	}
+
+	if (irq_get_next() < 0)
+		return;
+
+	irq_dispatch();
+	task_preempt_if_needed();
+}
+
 void task_pre_init(void)
 {
-	/* Nothing */
+	int i;
+
+	emu_thread = pthread_self();
+
+	/* Enable IRQs with the priorities defined by DECLARE_IRQ() */
+	for (i = 0; i < __irqprio_end - __irqprio; ++i) {
+		irq_prio[__irqprio[i].irq] = __irqprio[i].priority;
+		irq_enabled |= 1 << __irqprio[i].irq;
+	}
 }
 
 int in_interrupt_context(void)
 {
-	return 0; /* No interrupt support yet */
+	return irq_running_prio != IRQ_PRIO_NONE;
 }
 
 void interrupt_disable(void)
 {
-	/* Not supported yet */
+	interrupt_disabled = 1;
 }
 
 void interrupt_enable(void)
 {
-	/* Not supported yet */
+	interrupt_disabled = 0;
+	irq_check_pending();
+}
+
+void task_enable_irq(int irq)
+{
+	atomic_or(&irq_enabled, 1 << irq);
+	irq_check_pending();
+}
+
+void task_disable_irq(int irq)
+{
+	atomic_clear(&irq_enabled, 1 << irq);
+}
+
+void task_clear_pending_irq(int irq)
+{
+	atomic_clear(&irq_pending, 1 << irq);
+}
+
+void task_trigger_irq(int irq)
+{
+	atomic_or(&irq_pending, 1 << irq);
+	irq_check_pending();
+}
+
+#ifdef CONFIG_TASK_PROFILING
+void task_start_irq_handler(void *excep_return)
+{
+	irq_dist[irq_running]++;
+}
+#endif
+
+void task_resched_if_needed(void *excep_return)
+{
+	/*
+	 * Nothing to do; the dispatcher checks for a higher priority ready
+	 * task once the outermost handler returns.
+	 */
+}
+
+int task_start_called(void)
+{
+	return start_called;
 }
 
 uint32_t task_set_event(task_id_t tskid, uint32_t event, int wait)
 {
-	tasks[tskid].event = event;
-	if (wait)
+	atomic_or(&tasks[tskid].event, event);
+	atomic_or(&tasks_ready, 1 << tskid);
+
+	if (!is_emu_thread()) {
+		wake_scheduler();
+		return 0;
+	}
+
+	if (wait && !in_interrupt_context())
 		return task_wait_event(-1);
 	return 0;
 }
 
+static void timer_heap_set(int pos, task_id_t tskid)
+{
+	timer_heap[pos] = tskid;
+	timer_heap_pos[tskid] = pos;
+}
+
+static int timer_heap_before(int a, int b)
+{
+	return tasks[timer_heap[a]].wake_time.val <
+	       tasks[timer_heap[b]].wake_time.val;
+}
+
+static void timer_heap_swap(int a, int b)
+{
+	task_id_t t = timer_heap[a];
+
+	timer_heap_set(a, timer_heap[b]);
+	timer_heap_set(b, t);
+}
+
+static void timer_heap_sift_up(int pos)
+{
+	while (pos > 0 && timer_heap_before(pos, (pos - 1) / 2)) {
+		timer_heap_swap(pos, (pos - 1) / 2);
+		pos = (pos - 1) / 2;
+	}
+}
+
+static void timer_heap_sift_down(int pos)
+{
+	int child;
+
+	while ((child = 2 * pos + 1) < timer_heap_size) {
+		if (child + 1 < timer_heap_size &&
+		    timer_heap_before(child + 1, child))
+			child++;
+		if (!timer_heap_before(child, pos))
+			break;
+		timer_heap_swap(pos, child);
+		pos = child;
+	}
+}
+
+static void timer_heap_insert(task_id_t tskid)
+{
+	timer_heap_set(timer_heap_size++, tskid);
+	timer_heap_sift_up(timer_heap_pos[tskid]);
+}
+
+static void timer_heap_remove(task_id_t tskid)
+{
+	int pos = timer_heap_pos[tskid];
+
+	if (pos == TIMER_HEAP_NONE)
+		return;
+	timer_heap_pos[tskid] = TIMER_HEAP_NONE;
+
+	if (pos == --timer_heap_size)
+		return;
+	timer_heap_set(pos, timer_heap[timer_heap_size]);
+	if (pos > 0 && timer_heap_before(pos, (pos - 1) / 2))
+		timer_heap_sift_up(pos);
+	else
+		timer_heap_sift_down(pos);
+}
+
 uint32_t task_wait_event(int timeout_us)
 {
 	int tid = task_get_current();
-	int ret;
-	if (timeout_us > 0)
+
+	if (timeout_us > 0) {
 		tasks[tid].wake_time.val = get_time().val + timeout_us;
-	pthread_cond_signal(&scheduler_cond);
-	pthread_cond_wait(&tasks[tid].resume, &run_lock);
-	ret = tasks[tid].event;
-	tasks[tid].event = 0;
-	return ret;
+		timer_heap_insert(tid);
+	}
+	swapcontext(&tasks[tid].context, &scheduler_context);
+	atomic_clear(&tasks_ready, 1 << tid);
+	return atomic_read_clear(&tasks[tid].event);
 }
 
 void mutex_lock(struct mutex *mtx)
@@ -145,69 +445,116 @@ void mutex_unlock(struct mutex *mtx)
 
 task_id_t task_get_current(void)
 {
-	return my_task_id;
+	return running_task_id;
 }
 
-static task_id_t task_get_next_wake(void)
+int task_others_ready(void)
 {
-	int i;
-	timestamp_t min_time;
-	int which_task = TASK_ID_INVALID;
+	return (tasks_ready & ~(1 << task_get_current()) &
+		~(1 << TASK_ID_IDLE)) != 0;
+}
 
-	min_time.val = ~0ull;
+/**
+ * Wait for another thread to set an event or trigger an interrupt.
+ *
+ * @param deadline	Stop waiting at this system time; NULL to wait forever
+ */
+static void task_wait_external_event(const timestamp_t *deadline)
+{
+	struct timespec ts;
+	timestamp_t now;
+	uint64_t us;
 
-	for (i = TASK_ID_COUNT - 1; i >= 0; --i)
-		if (min_time.val >= tasks[i].wake_time.val) {
-			min_time.val = tasks[i].wake_time.val;
-			which_task = i;
+	pthread_mutex_lock(&external_lock);
+	while (!tasks_ready && irq_get_next() < 0) {
+		if (!deadline) {
+			pthread_cond_wait(&external_cond, &external_lock);
+			continue;
 		}
 
-	return which_task;
+		now = get_time();
+		if (now.val >= deadline->val)
+			break;
+		us = deadline->val - now.val;
+
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_sec += us / SECOND;
+		ts.tv_nsec += (us % SECOND) * 1000;
+		if (ts.tv_nsec >= 1000000000) {
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000;
+		}
+		pthread_cond_timedwait(&external_cond, &external_lock, &ts);
+	}
+	pthread_mutex_unlock(&external_lock);
+}
+
+static void task_run(task_id_t tskid)
+{
+#ifdef CONFIG_EMU_VIRTUAL_TIME
+	udelay(EMU_CONTEXT_SWITCH_US);
+#endif
+	running_task_id = tskid;
+	in_scheduler = 0;
+	swapcontext(&scheduler_context, &tasks[tskid].context);
+	in_scheduler = 1;
 }
 
 void task_scheduler(void)
 {
-	int i;
+	task_id_t i;
 	timestamp_t now;
 
+	in_scheduler = 1;
+	start_called = 1;
+
 	while (1) {
+		irq_dispatch();
+
+		/* Move tasks whose timer has expired to the ready set */
 		now = get_time();
-		i = TASK_ID_COUNT - 1;
-		while (i >= 0) {
-			if (tasks[i].event || now.val >= tasks[i].wake_time.val)
-				break;
-			--i;
+		while (timer_heap_size &&
+		       now.val >= tasks[timer_heap[0]].wake_time.val) {
+			i = timer_heap[0];
+			timer_heap_remove(i);
+			tasks[i].wake_time.val = ~0ull;
+			atomic_or(&tasks[i].event, TASK_EVENT_TIMER);
+			atomic_or(&tasks_ready, 1 << i);
 		}
-		if (i < 0) {
+
+		if (!tasks_ready) {
 			/*
 			 * No task has event pending, and thus we are only
-			 * waiting for the next wake-up timer to fire. Let's
-			 * just find out which timer is the next and fast
-			 * forward the system time to its deadline.
-			 *
-			 * Note that once we have interrupt support, we need
-			 * to take into account the fact that an interrupt
-			 * might set an event before the next timer fires.
+			 * waiting for the next wake-up timer to fire or an
+			 * external event. On virtual time, just fast forward
+			 * the system time to the earliest deadline.
 			 */
-			i = task_get_next_wake();
-			if (i == TASK_ID_INVALID)
-				i = TASK_ID_IDLE;
+			if (!timer_heap_size)
+				task_wait_external_event(NULL);
 			else
-				force_time(tasks[i].wake_time);
+#ifdef CONFIG_EMU_VIRTUAL_TIME
+				force_time(tasks[timer_heap[0]].wake_time);
+#else
+				task_wait_external_event(
+					&tasks[timer_heap[0]].wake_time);
+#endif
+			continue;
 		}
 
+		/* Run the highest priority ready task, cancelling its timer */
+		i = 31 - __builtin_clz(tasks_ready);
+		timer_heap_remove(i);
 		tasks[i].wake_time.val = ~0ull;
-		pthread_cond_signal(&tasks[i].resume);
-		pthread_cond_wait(&scheduler_cond, &run_lock);
+		task_run(i);
 	}
 }
 
-void *_task_start_impl(void *a)
+static void _task_start_impl(void)
 {
-	long tid = (long)a;
+	task_id_t tid = task_get_current();
 	struct task_args *arg = task_info + tid;
-	my_task_id = tid;
-	pthread_mutex_lock(&run_lock);
+
+	atomic_clear(&tasks_ready, 1 << tid);
 	tasks[tid].event = 0;
 	(arg->routine)(arg->d);
 	while (1)
@@ -218,21 +565,65 @@ int task_start(void)
 {
 	int i;
 
-	pthread_mutex_init(&run_lock, NULL);
-	pthread_cond_init(&scheduler_cond, NULL);
-
-	pthread_mutex_lock(&run_lock);
-
 	for (i = 0; i < TASK_ID_COUNT; ++i) {
 		tasks[i].event = TASK_EVENT_WAKE;
 		tasks[i].wake_time.val = ~0ull;
-		pthread_cond_init(&tasks[i].resume, NULL);
-		pthread_create(&tasks[i].thread, NULL, _task_start_impl,
-			       (void *)(uintptr_t)i);
-		pthread_cond_wait(&scheduler_cond, &run_lock);
+		timer_heap_pos[i] = TIMER_HEAP_NONE;
+		getcontext(&tasks[i].context);
+		tasks[i].context.uc_stack.ss_sp = malloc(EMU_TASK_STACK_SIZE);
+		if (!tasks[i].context.uc_stack.ss_sp) {
+			fprintf(stderr, "Can't allocate stack for task %d\n",
+				i);
+			exit(1);
+		}
+		tasks[i].context.uc_stack.ss_size = EMU_TASK_STACK_SIZE;
+		tasks[i].context.uc_link = &scheduler_context;
+		makecontext(&tasks[i].context, _task_start_impl, 0);
 	}
 
+	/* Let each task run its initialization in task ID order */
+	for (i = 0; i < TASK_ID_COUNT; ++i)
+		task_run(i);
+
 	task_scheduler();
 
 	return 0;
 }
+
+void task_print_list(void)
+{
+	int i;
+
+	ccputs("Task Ready Name         Events\n");
+
+	for (i = 0; i < TASK_ID_COUNT; i++) {
+		char is_ready = (tasks_ready & (1<<i)) ? 'R' : ' ';
+
+		ccprintf("%4d %c %-16s %08x\n", i, is_ready, task_names[i],
+			 tasks[i].event);
+		cflush();
+	}
+}
+
+static int command_task_info(int argc, char **argv)
+{
+#ifdef CONFIG_TASK_PROFILING
+	int i;
+#endif
+
+	task_print_list();
+
+#ifdef CONFIG_TASK_PROFILING
+	ccputs("IRQ counts by type:\n");
+	cflush();
+	for (i = 0; i < ARRAY_SIZE(irq_dist); i++)
+		if (irq_dist[i])
+			ccprintf("%4d %8d\n", i, irq_dist[i]);
+#endif
+
+	return EC_SUCCESS;
+}
+DECLARE_CONSOLE_COMMAND(taskinfo, command_task_info,
+			NULL,
+			"Print task info",
+			NULL);
@@ -12,30 +12,43 @@
 #include "task.h"
 #include "timer.h"
 
+void usleep(unsigned us)
+{
+	task_wait_event(us);
+}
+
+#ifdef CONFIG_EMU_VIRTUAL_TIME
 /*
- * For test that need to test for longer than 10 seconds, adjust
- * its time scale in test/build.mk by specifying
- * <test_name>-scale=<new scale>.
+ * Tests run on virtual time. The system time only advances when the
+ * scheduler fast-forwards to the next timer deadline, or when a task
+ * busy-waits with udelay().
  */
-#ifndef TEST_TIME_SCALE
-#define TEST_TIME_SCALE 1
-#endif
+static timestamp_t virtual_time;
 
-static timestamp_t boot_time;
-static int time_set;
+timestamp_t get_time(void)
+{
+	return virtual_time;
+}
 
-void usleep(unsigned us)
+void force_time(timestamp_t ts)
 {
-	task_wait_event(us);
+	virtual_time = ts;
 }
 
-timestamp_t _get_time(void)
+void udelay(unsigned us)
+{
+	virtual_time.val += us;
+}
+#else
+static timestamp_t boot_time;
+static int time_set;
+
+static timestamp_t _get_time(void)
 {
 	struct timespec ts;
 	timestamp_t ret;
 	clock_gettime(CLOCK_MONOTONIC, &ts);
-	ret.val = (1000000000 * (uint64_t)ts.tv_sec + ts.tv_nsec) *
-		  TEST_TIME_SCALE / 1000;
+	ret.val = (1000000000 * (uint64_t)ts.tv_sec + ts.tv_nsec) / 1000;
 	return ret;
 }
 
@@ -60,6 +73,7 @@ void udelay(unsigned us)
 	while (get_time().val < deadline.val)
 		;
 }
+#endif
 
 int timestamp_expired(timestamp_t deadline, const timestamp_t *now)
 {
@@ -75,6 +89,8 @@ int timestamp_expired(timestamp_t deadline, const timestamp_t *now)
 
 void timer_init(void)
 {
+#ifndef CONFIG_EMU_VIRTUAL_TIME
 	if (!time_set)
 		boot_time = _get_time();
+#endif
 }
@@ -186,6 +186,13 @@
  */
 #define CONFIG_CONSOLE_CMDHELP
 
+/*
+ * Size in words of the buffer holding cprintf_deferred() output until the
+ * hook task formats it.  Must be a power of two.  If undefined,
+ * cprintf_deferred() formats its output immediately, like cprintf().
+ */
+#undef CONFIG_CONSOLE_DEFERRED
+
 /*
  * Number of entries in console history buffer.
  *
@@ -196,6 +203,17 @@
 /* Max length of a single line of input */
 #define CONFIG_CONSOLE_INPUT_LINE_SIZE 80
 
+/*
+ * Limit output on each console channel other than CC_COMMAND to this many
+ * bytes per second, so one chatty channel can't crowd the others out of the
+ * UART buffer.  Output over the limit is dropped and counted; see the
+ * chstats command.  If undefined, output is not rate limited.
+ */
+#undef CONFIG_CONSOLE_RATE_LIMIT
+
+/* Bytes a channel may output in a burst before rate limiting applies */
+#define CONFIG_CONSOLE_RATE_BURST 256
+
 /*
  * Disable EC console input if the system is locked.  This is needed for
  * security on platforms where the EC console is accessible from outside the
@@ -264,6 +282,14 @@
 /* Compile support for EC chip internal data EEPROM */
 #undef CONFIG_EEPROM
 
+/*
+ * Run the emulator on virtual time, which fast-forwards to the next timer
+ * deadline whenever all tasks are waiting.  Emulator tests use this so their
+ * results don't depend on the host load; otherwise the emulator follows
+ * wall-clock time.
+ */
+#undef CONFIG_EMU_VIRTUAL_TIME
+
 /*
  * Compile the eoption module, which provides a higher-level interface to
  * options stored in internal data EEPROM.
@@ -298,6 +324,22 @@
 #undef CONFIG_FLASH_PHYSICAL_SIZE
 #undef CONFIG_FLASH_PROTECT_NEXT_BOOT
 #undef CONFIG_FLASH_SIZE
+
+/*
+ * Keep flash stats: erases per protect bank, appended after the persistent
+ * state, and latency histograms since boot.  Erase counts are only saved while
+ * the pstate bank is writable; once it is write protected they cover just the
+ * current boot.
+ */
+#undef CONFIG_FLASH_STATS
+
+/*
+ * Buffer small adjacent flash writes and program them together, up to
+ * CONFIG_FLASH_WRITE_IDEAL_SIZE at a time.  See flash_write_flush().  Only
+ * worth enabling for callers which issue many small writes without flushing.
+ */
+#undef CONFIG_FLASH_WRITE_COMBINE
+
 #undef CONFIG_FLASH_WRITE_IDEAL_SIZE
 #undef CONFIG_FLASH_WRITE_SIZE
 
@@ -341,6 +383,22 @@
  */
 #undef CONFIG_HOST_COMMAND_STATUS
 
+/*
+ * Keep per-command call counts and execution times, and a histogram of host
+ * command execution times (EC_CMD_HOST_COMMAND_STATS, "hcstats").  Costs a
+ * few words of RAM per host command.
+ */
+#undef CONFIG_HOST_COMMAND_STATS
+
+/*
+ * Number of received host commands which can wait for the host command task.
+ * Commands from different host interfaces can be pending at the same time;
+ * each interface still has only one request outstanding, since the LPC, SPI
+ * and I2C drivers own a single request buffer.  Commands are processed in the
+ * order received.  Must be a power of two.
+ */
+#define CONFIG_HOST_COMMAND_QUEUE_SIZE 4
+
 /*****************************************************************************/
 /* I2C configuration */
 
@@ -505,6 +563,12 @@
  */
 #undef CONFIG_SAVE_VBOOT_HASH
 
+/*
+ * Unroll the SHA-256 rounds.  Hashes faster and uses less stack, at the cost
+ * of larger code.
+ */
+#undef CONFIG_SHA256_UNROLL
+
 /* Compile support for SPI interfaces */
 #undef CONFIG_SPI
 
@@ -584,6 +648,13 @@
  */
 #define CONFIG_UART_TX_BUF_SIZE 512
 
+/*
+ * Transmit console output with DMA instead of filling the FIFO a character
+ * at a time from the UART interrupt.  The DMA channel for the console UART
+ * must not be used by any other module.
+ */
+#undef CONFIG_UART_TX_DMA
+
 /*
  * UART receive buffer size in bytes.  Must be a power of 2 for macros in
  * common/uart_buffering.c to work properly.  Must be larger than
@@ -79,6 +79,25 @@ int cputs(enum console_channel channel, const char *outstr);
  */
 int cprintf(enum console_channel channel, const char *format, ...);
 
+/**
+ * Print formatted output to the console channel later.
+ *
+ * Only the parameters are saved now; the output is formatted by the hook
+ * task, and "%T" prints the time of this call.  This is much cheaper than
+ * cprintf() for callers in interrupt context or on hot paths.  Strings
+ * passed for "%s" must still be valid when the output is formatted.
+ *
+ * @param channel	Output chanel
+ * @param format	Format string; see printf.h for valid formatting codes
+ *
+ * @return non-zero if output was dropped because the buffer was full.
+ */
+#ifdef CONFIG_CONSOLE_DEFERRED
+int cprintf_deferred(enum console_channel channel, const char *format, ...);
+#else
+#define cprintf_deferred cprintf
+#endif
+
 /**
  * Flush the console output for all channels.
  */
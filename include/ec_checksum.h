@@ -0,0 +1,66 @@
+/* Copyright (c) 2013 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+/* Host packet checksum functions */
+
+#ifndef __CROS_EC_EC_CHECKSUM_H
+#define __CROS_EC_EC_CHECKSUM_H
+
+#include <stdint.h>
+
+/*
+ * Number of words which can be summed in 16-bit lanes before a lane may
+ * overflow: 256 * 0xff < 0x10000.
+ */
+#define EC_CHECKSUM_FOLD_WORDS 256
+
+/**
+ * Add the bytes of a buffer to an 8-bit checksum.
+ *
+ * Bytes are summed a word at a time.  Each word is split into two sets of
+ * 16-bit lanes holding alternate bytes, and the lanes are folded together
+ * before they can overflow.
+ *
+ * @param csum		Checksum so far
+ * @param data		Data to add
+ * @param size		Size of data in bytes
+ * @return The updated checksum.
+ */
+static inline uint8_t ec_checksum_add(uint8_t csum, const void *data,
+				      int size)
+{
+	const uint8_t *d = (const uint8_t *)data;
+	const uint32_t *w;
+	uint32_t sum = csum;
+	uint32_t even, odd;
+	int n;
+
+	/* Sum leading bytes up to word alignment */
+	while (size > 0 && ((uintptr_t)d & 3)) {
+		sum += *d++;
+		size--;
+	}
+
+	w = (const uint32_t *)d;
+	while (size >= 4) {
+		even = odd = 0;
+		for (n = EC_CHECKSUM_FOLD_WORDS; n > 0 && size >= 4;
+		     n--, size -= 4) {
+			even += *w & 0x00ff00ff;
+			odd += (*w++ >> 8) & 0x00ff00ff;
+		}
+		sum += (even & 0xffff) + (even >> 16) +
+		       (odd & 0xffff) + (odd >> 16);
+	}
+
+	/* Sum trailing bytes */
+	d = (const uint8_t *)w;
+	while (size-- > 0)
+		sum += *d++;
+
+	return (uint8_t)sum;
+}
+
+#endif  /* __CROS_EC_EC_CHECKSUM_H */
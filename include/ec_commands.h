@@ -205,7 +205,8 @@ enum ec_status {
 	EC_RES_OVERFLOW = 11,		/* Table / data overflow */
 	EC_RES_INVALID_HEADER = 12,     /* Header contains invalid data */
 	EC_RES_REQUEST_TRUNCATED = 13,  /* Didn't get the entire request */
-	EC_RES_RESPONSE_TOO_BIG = 14    /* Response was too big to handle */
+	EC_RES_RESPONSE_TOO_BIG = 14,   /* Response was too big to handle */
+	EC_RES_BUSY = 15                /* Command queue full; retry later */
 };
 
 /*
@@ -585,6 +586,99 @@ struct ec_cmd_get_set_value {
 	uint32_t value;
 } __packed;
 
+/*
+ * Run several commands in one request, to save bus round trips when reading
+ * a set of status values.
+ *
+ * The params are an ec_params_batch header followed by 'count' sub-requests.
+ * Each sub-request is an ec_params_batch_cmd header followed by data_len
+ * bytes of params for that command.
+ *
+ * The response is an ec_response_batch header followed by one sub-response
+ * per command which was run.  Each sub-response is an ec_response_batch_cmd
+ * header followed by data_len bytes of response data from that command.
+ *
+ * Sub-requests and sub-responses are each padded to a multiple of
+ * EC_BATCH_ALIGN bytes, so the params and response data of every command are
+ * word-aligned.  Commands are run in order.  A batch may not contain another
+ * batch command.
+ */
+#define EC_CMD_BATCH 0x0d
+
+#define EC_BATCH_ALIGN 4
+#define EC_BATCH_PAD(size) (((size) + EC_BATCH_ALIGN - 1) & \
+			    ~(EC_BATCH_ALIGN - 1))
+
+/* Stop at the first command which doesn't return EC_RES_SUCCESS */
+#define EC_BATCH_FLAG_STOP_ON_ERROR (1 << 0)
+
+struct ec_params_batch {
+	uint8_t count;		/* Number of sub-requests which follow */
+	uint8_t flags;		/* EC_BATCH_FLAG_* */
+	uint16_t reserved;
+} __packed;
+
+struct ec_params_batch_cmd {
+	uint16_t command;	/* Command code */
+	uint8_t command_version;
+	uint8_t data_len;	/* Length of params which follow */
+} __packed;
+
+struct ec_response_batch {
+	uint8_t count;		/* Number of sub-responses which follow */
+	uint8_t reserved[3];
+} __packed;
+
+struct ec_response_batch_cmd {
+	uint16_t result;	/* Result code (EC_RES_*) for this command */
+	uint16_t data_len;	/* Length of response data which follows */
+} __packed;
+
+/*
+ * Get host command statistics: a histogram of command execution times and,
+ * for each command which has been run since the statistics were last reset,
+ * how often it was called and how long it took.
+ *
+ * Commands are returned starting at entry 'offset', as many as fit in the
+ * response.  Only present if the EC was built with CONFIG_HOST_COMMAND_STATS.
+ */
+#define EC_CMD_HOST_COMMAND_STATS 0x0e
+
+/* Reset all statistics after reading them */
+#define EC_HCSTATS_FLAG_RESET (1 << 0)
+
+/*
+ * Histogram buckets.  Bucket 0 counts commands which took less than 1 us;
+ * bucket n counts commands which took [2^(n-1), 2^n) us.  The last bucket
+ * also counts everything slower.
+ */
+#define EC_HCSTATS_HISTOGRAM_BUCKETS 16
+
+struct ec_params_host_command_stats {
+	uint16_t offset;	/* First command entry to return */
+	uint8_t flags;		/* EC_HCSTATS_FLAG_* */
+	uint8_t reserved;
+} __packed;
+
+struct ec_hcstats_entry {
+	uint16_t command;	/* Command code */
+	uint16_t reserved;
+	uint32_t calls;		/* Number of times run */
+	uint32_t errors;	/* Number of results other than success */
+	uint32_t in_progress;	/* Number of in-progress results sent */
+	uint32_t min_us;	/* Fastest execution time */
+	uint32_t max_us;	/* Slowest execution time */
+	uint32_t avg_us;	/* Average execution time */
+} __packed;
+
+struct ec_response_host_command_stats {
+	uint16_t total;		/* Total number of command entries */
+	uint8_t count;		/* Number of entries in this response */
+	uint8_t reserved;
+	uint32_t histogram[EC_HCSTATS_HISTOGRAM_BUCKETS];
+	struct ec_hcstats_entry entries[0];
+} __packed;
+
 /*****************************************************************************/
 /* Flash commands */
 
@@ -643,6 +737,41 @@ struct ec_response_flash_info_1 {
 	uint32_t flags;
 } __packed;
 
+/*
+ * Number of buckets in flash operation latency histograms.  Bucket n counts
+ * operations which took less than EC_FLASH_STATS_BUCKET_US(n) us and didn't
+ * fit in a lower bucket; the last bucket counts all slower operations.
+ */
+#define EC_FLASH_STATS_BUCKETS 8
+#define EC_FLASH_STATS_BUCKET_US(n) (16 << (2 * (n)))
+
+/*
+ * Version 2 returns the same initial fields as version 1, with flash wear
+ * and latency stats following.  Only supported if the EC keeps the stats.
+ */
+struct ec_response_flash_info_2 {
+	/* Version 0 and 1 fields; see above for description */
+	uint32_t flash_size;
+	uint32_t write_block_size;
+	uint32_t erase_block_size;
+	uint32_t protect_block_size;
+	uint32_t write_ideal_size;
+	uint32_t flags;
+
+	/* Version 2 adds these fields: */
+	/* Total erase blocks erased, and most erased in any protect block */
+	uint32_t erase_count_total;
+	uint32_t erase_count_max;
+
+	/* Slowest operations since boot, in us */
+	uint32_t write_max_us;
+	uint32_t erase_max_us;
+
+	/* Latency histograms since boot; see EC_FLASH_STATS_BUCKET_US() */
+	uint32_t write_hist[EC_FLASH_STATS_BUCKETS];
+	uint32_t erase_hist[EC_FLASH_STATS_BUCKETS];
+} __packed;
+
 /*
  * Read flash
  *
@@ -655,6 +784,22 @@ struct ec_params_flash_read {
 	uint32_t size;     /* Size to read in bytes */
 } __packed;
 
+/*
+ * Version 1 reads several regions in one command.  Response is the data from
+ * each region in turn, with no padding between them.  The total size must
+ * fit in the response buffer.
+ */
+#define EC_VER_FLASH_READ_MULTI 1
+
+/* Maximum number of regions in a version 1 read */
+#define EC_FLASH_READ_MULTI_MAX 8
+
+struct ec_params_flash_read_multi {
+	uint8_t count;     /* Number of regions */
+	uint8_t reserved[3];
+	struct ec_params_flash_read region[0];
+} __packed;
+
 /* Write flash */
 #define EC_CMD_FLASH_WRITE 0x12
 #define EC_VER_FLASH_WRITE 1
@@ -781,6 +926,35 @@ struct ec_response_vbnvcontext {
 	uint8_t block[EC_VBNV_BLOCK_SIZE];
 } __packed;
 
+/*
+ * Get the CRC-32 (IEEE 802.3) of each of a run of equal-sized flash blocks,
+ * so the host can tell which blocks differ from an image without reading
+ * the flash back.
+ *
+ * Response is params.count CRCs of uint32_t.
+ */
+#define EC_CMD_FLASH_BLOCK_CRC 0x1a
+
+struct ec_params_flash_block_crc {
+	uint32_t offset;      /* Byte offset of first block */
+	uint32_t block_size;  /* Size of each block in bytes */
+	uint32_t count;       /* Number of blocks */
+} __packed;
+
+/*
+ * Get which erase blocks of flash are erased, so the host can skip erasing
+ * blocks which are already blank.
+ *
+ * Response is a bitmap of (params.count + 7) / 8 bytes; bit (n % 8) of byte
+ * (n / 8) is set if block n is erased.
+ */
+#define EC_CMD_FLASH_ERASED_MAP 0x1b
+
+struct ec_params_flash_erased_map {
+	uint32_t offset;  /* Byte offset of first block; erase block aligned */
+	uint32_t count;   /* Number of erase blocks */
+} __packed;
+
 /*****************************************************************************/
 /* PWM commands */
 
@@ -1015,6 +1189,36 @@ struct ec_response_vboot_hash {
 	uint8_t hash_digest[64]; /* Hash digest data */
 } __packed;
 
+/*
+ * Version 1 returns the same initial fields as version 0, with hash
+ * throughput statistics following.
+ */
+struct ec_response_vboot_hash_1 {
+	/* Version 0 fields; see above for description */
+	uint8_t status;
+	uint8_t hash_type;
+	uint8_t digest_size;
+	uint8_t reserved0;
+	uint32_t offset;
+	uint32_t size;
+	uint8_t hash_digest[64];
+
+	/* Version 1 adds these fields: */
+	/*
+	 * Number of bytes of flash read to compute the hash.  This is less
+	 * than size if the hash was resumed after a partial flash update.
+	 */
+	uint32_t hashed_size;
+	uint32_t hash_time_us;   /* Time from start to finish of hash */
+} __packed;
+
+/*
+ * Version 2 returns the same response as version 1.  On ECs which support
+ * EC_CMD_GET_COMMS_STATUS, EC_VBOOT_HASH_RECALC may return EC_RES_IN_PROGRESS
+ * instead of holding the host until the hash is done; poll for the command
+ * to finish, then fetch the response with EC_CMD_RESEND_RESPONSE.
+ */
+
 enum ec_vboot_hash_cmd {
 	EC_VBOOT_HASH_GET = 0,       /* Get current hash status */
 	EC_VBOOT_HASH_ABORT = 1,     /* Abort calculating current hash */
@@ -1452,9 +1656,46 @@ struct ec_params_charge_control {
  *
  * Response is null-terminated string.  Empty string, if there is no more
  * remaining output.
+ *
+ * Version 1 needs no snapshot.  Each byte of console output is numbered
+ * with a sequence number, and the host asks for output starting at a
+ * sequence number.  The response holds whole lines (unless a single line
+ * doesn't fit), and the sequence number to pass to the next read.  If the
+ * requested output has already been overwritten, the response starts at
+ * the oldest whole line still available; response seq then differs from
+ * the requested one.  Start from sequence number 0 to read everything.
  */
 #define EC_CMD_CONSOLE_READ 0x98
 
+struct ec_params_console_read_v1 {
+	uint32_t seq;		/* Sequence number of first byte to read */
+} __packed;
+
+struct ec_response_console_read_v1 {
+	uint32_t seq;		/* Sequence number of data[0] */
+	uint32_t next_seq;	/* Sequence number for the next read */
+	char data[0];		/* Null-terminated output */
+} __packed;
+
+/*
+ * Get console output statistics for one channel.  Returns
+ * EC_RES_INVALID_PARAM if the channel doesn't exist, so the host can loop
+ * over channels until it gets that.  Dropped formatted output is counted as
+ * the size of its format string.
+ */
+#define EC_CMD_CONSOLE_CHANNEL_STATS 0x9f
+
+struct ec_params_console_channel_stats {
+	uint8_t channel;	/* Channel index */
+} __packed;
+
+struct ec_response_console_channel_stats {
+	char name[16];		/* Null-terminated channel name */
+	uint32_t bytes;		/* Bytes output */
+	uint32_t dropped_full;	/* Bytes dropped because buffer was full */
+	uint32_t dropped_rate;	/* Bytes dropped by rate limiting */
+} __packed;
+
 /*****************************************************************************/
 
 /*
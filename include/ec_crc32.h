@@ -0,0 +1,43 @@
+/* Copyright (c) 2013 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+/* CRC-32 (IEEE 802.3) functions */
+
+#ifndef __CROS_EC_EC_CRC32_H
+#define __CROS_EC_EC_CRC32_H
+
+#include <stdint.h>
+
+/**
+ * Add the bytes of a buffer to a CRC-32.
+ *
+ * Uses a 16-entry table and processes a nibble at a time, which is a fair
+ * trade between speed and table size on the EC.
+ *
+ * @param crc		CRC so far; 0 to start a new CRC
+ * @param data		Data to add
+ * @param size		Size of data in bytes
+ * @return The updated CRC.
+ */
+static inline uint32_t ec_crc32_add(uint32_t crc, const void *data, int size)
+{
+	static const uint32_t table[16] = {
+		0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac,
+		0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+		0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c,
+		0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c};
+	const uint8_t *d = (const uint8_t *)data;
+
+	crc = ~crc;
+	while (size-- > 0) {
+		crc ^= *d++;
+		crc = (crc >> 4) ^ table[crc & 0xf];
+		crc = (crc >> 4) ^ table[crc & 0xf];
+	}
+
+	return ~crc;
+}
+
+#endif  /* __CROS_EC_EC_CRC32_H */
@@ -165,12 +165,32 @@ int flash_dataptr(int offset, int size_req, int align, const char **ptrp);
  *
  * Offset and size must be a multiple of CONFIG_FLASH_WRITE_SIZE.
  *
+ * With CONFIG_FLASH_WRITE_COMBINE, the data may only reach flash when
+ * flash_write_flush() is called.
+ *
  * @param offset	Flash offset to write.
  * @param size	        Number of bytes to write.
  * @param data          Data to write to flash.  Must be 32-bit aligned.
  */
 int flash_write(int offset, int size, const char *data);
 
+/**
+ * Flush writes held in the write-combining buffer to flash.
+ *
+ * With CONFIG_FLASH_WRITE_COMBINE, flash_write() may buffer small writes so
+ * adjacent ones can be programmed together; errors programming them are
+ * returned from here.  Erases, direct reads via flash_dataptr() and sysjumps
+ * flush the buffer implicitly.  Without CONFIG_FLASH_WRITE_COMBINE this
+ * does nothing.
+ *
+ * @return EC_SUCCESS, or nonzero if error.
+ */
+#ifdef CONFIG_FLASH_WRITE_COMBINE
+int flash_write_flush(void);
+#else
+static inline int flash_write_flush(void) { return EC_SUCCESS; }
+#endif
+
 /**
  * Erase flash.
  *
@@ -99,6 +99,16 @@ struct host_packet {
 	enum ec_status driver_result;
 };
 
+/* Host command statistics */
+struct host_command_stats {
+	uint32_t calls;		/* Number of times run */
+	uint32_t errors;	/* Number of results other than success */
+	uint32_t in_progress;	/* Number of in-progress results sent */
+	uint32_t min_us;	/* Fastest execution time */
+	uint32_t max_us;	/* Slowest execution time */
+	uint64_t total_us;	/* Sum of execution times */
+};
+
 /* Host command */
 struct host_command {
 	/*
@@ -110,6 +120,10 @@ struct host_command {
 	int command;
 	/* Mask of supported versions */
 	int version_mask;
+#ifdef CONFIG_HOST_COMMAND_STATS
+	/* Statistics for the command */
+	struct host_command_stats *stats;
+#endif
 };
 
 /**
@@ -176,6 +190,28 @@ void board_process_wake_events(uint32_t active_wake_events);
  */
 void host_send_response(struct host_cmd_handler_args *args);
 
+/* Size of the response buffer for commands which finish after responding */
+#define HOST_ASYNC_RESPONSE_MAX 128
+
+/**
+ * Send an interim EC_RES_IN_PROGRESS response for a slow command.
+ *
+ * This releases the host interface while the command carries on.  The host
+ * can poll EC_CMD_GET_COMMS_STATUS, then fetch the final result and response
+ * data with EC_CMD_RESEND_RESPONSE.
+ *
+ * The command handler must copy anything it still needs from its params
+ * before calling this, and use the returned args from then on; the response
+ * buffer in them holds HOST_ASYNC_RESPONSE_MAX bytes.  If the command can't
+ * finish later (CONFIG_HOST_COMMAND_STATUS is not defined, or the command was
+ * not received from the host), this does nothing and returns args.
+ *
+ * @param args		Command handler args
+ * @return The args to use for the rest of the command.
+ */
+struct host_cmd_handler_args *host_command_in_progress(
+	struct host_cmd_handler_args *args);
+
 /**
  * Called by host interface module when a command is received.
  */
@@ -198,11 +234,28 @@ int host_request_expected_size(const struct ec_host_request *r);
  */
 void host_packet_receive(struct host_packet *pkt);
 
+/*
+ * Entries are forced to their natural alignment, since some compilers align
+ * larger objects more strictly and would leave gaps in the table.
+ */
+#define HCMD_ATTRS							\
+	__attribute__((section(".rodata.hcmds"),			\
+		       aligned(__alignof__(struct host_command))))
+
 /* Register a host command handler */
+#ifdef CONFIG_HOST_COMMAND_STATS
+#define DECLARE_HOST_COMMAND(command, routine, version_mask)		\
+	static struct host_command_stats __host_cmd_stats_##command;	\
+	const struct host_command __host_cmd_##command			\
+	HCMD_ATTRS							\
+	     = {routine, command, version_mask,				\
+		&__host_cmd_stats_##command}
+#else
 #define DECLARE_HOST_COMMAND(command, routine, version_mask)		\
 	const struct host_command __host_cmd_##command			\
-	__attribute__((section(".rodata.hcmds")))			\
+	HCMD_ATTRS							\
 	     = {routine, command, version_mask}
+#endif
 
 
 /**
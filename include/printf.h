@@ -67,6 +67,35 @@
 int vfnprintf(int (*addchar)(void *context, int c), void *context,
 	      const char *format, va_list args);
 
+/**
+ * Pack the arguments for a format string into words, so the string can be
+ * formatted later by vfnprintf_packed().
+ *
+ * "%T" packs the current time.  Strings and binary data ("%s" and "%h") are
+ * packed by reference, so they must still be valid when formatted.
+ *
+ * @param words		Destination for packed arguments
+ * @param max_words	Number of words available at words
+ * @param format	Format string (see above for acceptable formats)
+ * @param args		Parameters
+ * @return The number of words used, or -1 if they don't fit.
+ */
+int printf_pack_args(uintptr_t *words, int max_words, const char *format,
+		     va_list args);
+
+/**
+ * Print formatted output to a function, like vfnprintf(), taking the
+ * parameters from words packed by printf_pack_args().
+ *
+ * @param addchar	Function to be called for each character added
+ * @param context	Context pointer to pass to addchar()
+ * @param format	Format string the parameters were packed for
+ * @param args		Packed parameters
+ * @return EC_SUCCESS, or non-zero if output was truncated.
+ */
+int vfnprintf_packed(int (*addchar)(void *context, int c), void *context,
+		     const char *format, const uintptr_t *args);
+
 /**
  * Print formatted outut to a string.
  *
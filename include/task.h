@@ -98,6 +98,14 @@ uint32_t *task_get_event_bitmap(task_id_t tskid);
  * @return The bitmap of received events. */
 uint32_t task_wait_event(int timeout_us);
 
+/**
+ * Return non-zero if any task other than the calling task and the idle task
+ * is ready to run.
+ *
+ * Lets long-running low priority work decide whether to yield.
+ */
+int task_others_ready(void);
+
 /**
  * Prints the list of tasks.
  *
@@ -64,6 +64,14 @@ int uart_printf(const char *format, ...);
  */
 int uart_vprintf(const char *format, va_list args);
 
+/**
+ * Print formatted output to the UART, taking parameters packed by
+ * printf_pack_args().
+ *
+ * @return EC_SUCCESS, or non-zero if output was truncated.
+ */
+int uart_printf_packed(const char *format, const uintptr_t *args);
+
 /**
  * Flush output.  Blocks until UART has transmitted all output.
  */
@@ -131,6 +139,25 @@ int uart_tx_ready(void);
  */
 int uart_tx_in_progress(void);
 
+/**
+ * Return non-zero if the last transmit DMA transfer has completed.
+ *
+ * Only used when CONFIG_UART_TX_DMA is defined.
+ */
+int uart_tx_dma_ready(void);
+
+/**
+ * Start a transmit DMA transfer.
+ *
+ * Only used when CONFIG_UART_TX_DMA is defined.  The driver must interrupt
+ * and call uart_process() when the transfer completes.
+ *
+ * @param src		Data to send; must remain valid until the transfer
+ *			completes.
+ * @param len		Number of bytes to send.
+ */
+void uart_tx_dma_start(const char *src, int len);
+
 /**
  * Return non-zero if the UART has a character available to read.
  */
@@ -197,6 +224,18 @@ void uart_process(void);
  */
 int uart_buffer_empty(void);
 
+/**
+ * Get transmit buffer statistics.
+ *
+ * Both counts are since boot, include the carriage returns added before
+ * newlines, and wrap at 2^32.
+ *
+ * @param written	Set to the number of bytes put in the transmit buffer.
+ * @param dropped	Set to the number of bytes dropped because the
+ *			transmit buffer was full.
+ */
+void uart_get_tx_stats(uint32_t *written, uint32_t *dropped);
+
 /**
  * Disable the EC console UART and convert the UART RX pin to a generic GPIO
  * with an edge detect interrupt.
@@ -31,13 +31,22 @@ test-list-$(BOARD_bolt)=
 # Emulator tests
 test-list-host=mutex pingpong utils kb_scan kb_mkbp lid_sw power_button hooks
 test-list-host+=thermal flash queue kb_8042 extpwr_gpio console_edit system
-test-list-host+=sbs_charging adapter thermal_falco
+test-list-host+=sbs_charging adapter thermal_falco host_command
+test-list-host+=vboot_hash sha256 sha256_unroll flash_write_combine flash_wear
+test-list-host+=console_deferred console_read console_rate flash_erase_map
 
 adapter-y=adapter.o
+console_deferred-y=console_deferred.o
 console_edit-y=console_edit.o
+console_rate-y=console_rate.o
+console_read-y=console_read.o
 extpwr_gpio-y=extpwr_gpio.o
 flash-y=flash.o
+flash_erase_map-y=flash_erase_map.o
+flash_wear-y=flash_wear.o
+flash_write_combine-y=flash_write_combine.o
 hooks-y=hooks.o
+host_command-y=host_command.o
 kb_8042-y=kb_8042.o
 kb_mkbp-y=kb_mkbp.o
 kb_scan-y=kb_scan.o
@@ -48,6 +57,8 @@ power_button-y=power_button.o
 powerdemo-y=powerdemo.o
 queue-y=queue.o
 sbs_charging-y=sbs_charging.o
+sha256-y=sha256.o
+sha256_unroll-y=sha256.o
 stress-y=stress.o
 system-y=system.o
 thermal-y=thermal.o
@@ -55,3 +66,4 @@ thermal_falco-y=thermal_falco.o
 timer_calib-y=timer_calib.o
 timer_dos-y=timer_dos.o
 utils-y=utils.o
+vboot_hash-y=vboot_hash.o
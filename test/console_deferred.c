@@ -0,0 +1,175 @@
+/* Copyright (c) 2013 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Test packed printf parameters and deferred console output.
+ */
+
+#include "common.h"
+#include "console.h"
+#include "ec_commands.h"
+#include "host_command.h"
+#include "printf.h"
+#include "test_util.h"
+#include "timer.h"
+#include "uart.h"
+#include "util.h"
+
+/* Context for buf_addchar() */
+struct buf_context {
+	char *str;
+	int size;
+};
+
+static int buf_addchar(void *context, int c)
+{
+	struct buf_context *ctx = (struct buf_context *)context;
+
+	if (ctx->size <= 1)
+		return 1;
+	*ctx->str++ = c;
+	ctx->size--;
+	return 0;
+}
+
+/* Pack parameters, then format them into buf */
+static int packed_snprintf(char *buf, int size, const char *format, ...)
+{
+	uintptr_t words[8];
+	struct buf_context ctx = { buf, size };
+	va_list args;
+	int n;
+
+	va_start(args, format);
+	n = printf_pack_args(words, ARRAY_SIZE(words), format, args);
+	va_end(args);
+	if (n < 0)
+		return n;
+
+	/* Formatting happens later */
+	usleep(1000);
+
+	vfnprintf_packed(buf_addchar, &ctx, format, words);
+	*ctx.str = '\0';
+	return n;
+}
+
+struct console_read_resp {
+	struct ec_response_console_read_v1 r;
+	char data[CONFIG_UART_TX_BUF_SIZE];
+} __packed;
+
+/*
+ * Read console output from seq up to the end of the last whole line.
+ * Returns the sequence number after it.
+ */
+static uint32_t read_output(uint32_t seq, char *buf, int size)
+{
+	struct ec_params_console_read_v1 p;
+	static struct console_read_resp resp;
+	int len = 0;
+
+	do {
+		p.seq = seq;
+		memset(&resp, 0, sizeof(resp));
+		test_send_host_command(EC_CMD_CONSOLE_READ, 1, &p, sizeof(p),
+				       &resp, sizeof(resp));
+		seq = resp.r.next_seq;
+		strzcpy(buf + len, resp.data, size - len);
+		len += strlen(buf + len);
+	} while (resp.data[0] && len < size - 1);
+
+	return seq;
+}
+
+#define CHECK_FORMAT(format, args...) \
+	do { \
+		snprintf(expect, sizeof(expect), format, ## args); \
+		TEST_ASSERT(packed_snprintf(got, sizeof(got), format, \
+					    ## args) >= 0); \
+		TEST_ASSERT_ARRAY_EQ(got, expect, strlen(expect) + 1); \
+	} while (0)
+
+static int test_packed(void)
+{
+	char expect[80], got[80];
+	uint64_t t;
+
+	CHECK_FORMAT("%d %u %x %X %b", -5, 6, 0xab, 0xcd, 5);
+	CHECK_FORMAT("%-5s|%5s|%.2s|%s", "ab", "cd", "efg", NULL);
+	CHECK_FORMAT("%08x %lx %ld %c%c", 0x1234, 0x123456789abcULL,
+		     -12345678901LL, 'o', 'k');
+	CHECK_FORMAT("%*d|%-*d|%.3d|%%", 4, 7, 3, 8, 1234);
+	CHECK_FORMAT("%.4h", "\x01\x23\x45\x67");
+
+	/* %T is the time the parameters were packed */
+	t = get_time().val;
+	snprintf(expect, sizeof(expect), "[%.6ld]", t);
+	TEST_ASSERT(packed_snprintf(got, sizeof(got), "[%T]") >= 0);
+	TEST_ASSERT_ARRAY_EQ(got, expect, strlen(expect) + 1);
+
+	/* Too many parameters */
+	TEST_ASSERT(packed_snprintf(got, sizeof(got), "%d%d%d%d%d%d%d%d%d",
+				    1, 2, 3, 4, 5, 6, 7, 8, 9) == -1);
+
+	return EC_SUCCESS;
+}
+
+static int test_deferred(void)
+{
+	char expect[CONFIG_UART_TX_BUF_SIZE], got[CONFIG_UART_TX_BUF_SIZE];
+	uint32_t seq;
+	uint64_t t;
+	int i, n, len;
+
+	/* Start reading after the output so far */
+	uart_puts("\n");
+	cflush();
+	seq = read_output(0, got, sizeof(got));
+
+	/* Fill the buffer until output is dropped */
+	t = get_time().val;
+	for (n = 0; n < CONFIG_CONSOLE_DEFERRED; n++) {
+		if (cprintf_deferred(CC_COMMAND, "[%T deferred %d]\n", n))
+			break;
+	}
+	TEST_ASSERT(n > 0 && n < CONFIG_CONSOLE_DEFERRED);
+
+	/* Nothing is output until the hook task drains it */
+	TEST_ASSERT(read_output(seq, got, sizeof(got)) == seq);
+	msleep(10);
+
+	/* Then it's output in order, with the time of each call */
+	for (i = 0, len = 0; i < n; i++, len += strlen(expect + len))
+		snprintf(expect + len, sizeof(expect) - len,
+			 "[%.6ld deferred %d]\r\n", t, i);
+	strzcpy(expect + len, "\r\n[1 deferred console lines dropped]\r\n",
+		sizeof(expect) - len);
+	seq = read_output(seq, got, sizeof(got));
+	TEST_ASSERT_ARRAY_EQ(got, expect, strlen(expect) + 1);
+
+	/* Once drained, there's room again */
+	t = get_time().val;
+	TEST_ASSERT(cprintf_deferred(CC_COMMAND, "[%T deferred %s]\n",
+				     "again") == EC_SUCCESS);
+	cflush();
+	snprintf(expect, sizeof(expect), "[%.6ld deferred again]\r\n", t);
+	read_output(seq, got, sizeof(got));
+	TEST_ASSERT_ARRAY_EQ(got, expect, strlen(expect) + 1);
+
+	return EC_SUCCESS;
+}
+
+void run_test(void)
+{
+	test_reset();
+
+	/* Host command debug output would mix with the output under test */
+	UART_INJECT("hcdebug off\n");
+	msleep(30);
+
+	RUN_TEST(test_packed);
+	RUN_TEST(test_deferred);
+
+	test_print_result();
+}
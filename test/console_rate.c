@@ -0,0 +1,113 @@
+/* Copyright (c) 2013 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Test console channel rate limiting and output statistics.
+ */
+
+#include "common.h"
+#include "console.h"
+#include "ec_commands.h"
+#include "host_command.h"
+#include "test_util.h"
+#include "timer.h"
+#include "util.h"
+
+/* Line and its size in the UART buffer, counting the carriage return */
+#define LINE "0123456789012345678901234567890\n"
+#define LINE_BYTES 33
+
+static int get_stats(enum console_channel channel,
+		     struct ec_response_console_channel_stats *r)
+{
+	struct ec_params_console_channel_stats p;
+
+	p.channel = channel;
+	return test_send_host_command(EC_CMD_CONSOLE_CHANNEL_STATS, 0,
+				      &p, sizeof(p), r, sizeof(*r));
+}
+
+static int test_rate_limit(void)
+{
+	struct ec_response_console_channel_stats before, after;
+	int i;
+
+	/* Let the channel's burst refill */
+	msleep(CONFIG_CONSOLE_RATE_BURST * SECOND / CONFIG_CONSOLE_RATE_LIMIT /
+	       MSEC);
+	TEST_ASSERT(get_stats(CC_SWITCH, &before) == EC_RES_SUCCESS);
+	TEST_ASSERT_ARRAY_EQ(before.name, "switch", 7);
+
+	/* Output is allowed until the burst is used up */
+	for (i = 0; i < CONFIG_CONSOLE_RATE_BURST / LINE_BYTES + 1; i++)
+		TEST_ASSERT(cputs(CC_SWITCH, LINE) == EC_SUCCESS);
+	TEST_ASSERT(cputs(CC_SWITCH, LINE) == EC_ERROR_OVERFLOW);
+	TEST_ASSERT(cprintf(CC_SWITCH, "%d\n", 12345) == EC_ERROR_OVERFLOW);
+
+	TEST_ASSERT(get_stats(CC_SWITCH, &after) == EC_RES_SUCCESS);
+	TEST_ASSERT(after.bytes - before.bytes == i * LINE_BYTES);
+	/* Dropped cprintf() output is counted as the size of its format */
+	TEST_ASSERT(after.dropped_rate - before.dropped_rate ==
+		    LINE_BYTES + 4);
+	TEST_ASSERT(after.dropped_full == before.dropped_full);
+
+	/* Other channels aren't affected */
+	TEST_ASSERT(cputs(CC_SYSTEM, LINE) == EC_SUCCESS);
+
+	/* Nor is command output */
+	for (i = 0; i < CONFIG_CONSOLE_RATE_BURST / LINE_BYTES + 2; i++)
+		TEST_ASSERT(ccputs(LINE) == EC_SUCCESS);
+
+	/* The channel may output again once its bucket refills */
+	msleep(LINE_BYTES * SECOND / CONFIG_CONSOLE_RATE_LIMIT / MSEC + 1);
+	TEST_ASSERT(cputs(CC_SWITCH, LINE) == EC_SUCCESS);
+	cflush();
+
+	return EC_SUCCESS;
+}
+
+static int test_dropped_full(void)
+{
+	struct ec_response_console_channel_stats before, after;
+	int i;
+
+	cflush();
+	TEST_ASSERT(get_stats(CC_COMMAND, &before) == EC_RES_SUCCESS);
+
+	/* Stop the UART sending, so the transmit buffer fills */
+	UART_INJECT("\x11");
+	msleep(1);
+	for (i = 0; i < CONFIG_UART_TX_BUF_SIZE / LINE_BYTES + 1; i++)
+		ccputs(LINE);
+	UART_INJECT("\x13");
+	msleep(1);
+	cflush();
+
+	TEST_ASSERT(get_stats(CC_COMMAND, &after) == EC_RES_SUCCESS);
+	TEST_ASSERT(after.dropped_full != before.dropped_full);
+	TEST_ASSERT(after.bytes - before.bytes +
+		    after.dropped_full - before.dropped_full ==
+		    i * LINE_BYTES);
+
+	return EC_SUCCESS;
+}
+
+static int test_bad_channel(void)
+{
+	struct ec_response_console_channel_stats r;
+
+	TEST_ASSERT(get_stats(CC_CHANNEL_COUNT, &r) == EC_RES_INVALID_PARAM);
+
+	return EC_SUCCESS;
+}
+
+void run_test(void)
+{
+	test_reset();
+
+	RUN_TEST(test_rate_limit);
+	RUN_TEST(test_dropped_full);
+	RUN_TEST(test_bad_channel);
+
+	test_print_result();
+}
@@ -0,0 +1,158 @@
+/* Copyright (c) 2013 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Test reading console output by sequence number.
+ */
+
+#include "common.h"
+#include "console.h"
+#include "ec_commands.h"
+#include "host_command.h"
+#include "test_util.h"
+#include "timer.h"
+#include "uart.h"
+#include "util.h"
+
+struct console_read_resp {
+	struct ec_response_console_read_v1 r;
+	char data[CONFIG_UART_TX_BUF_SIZE];
+} __packed;
+
+static struct console_read_resp resp;
+
+static int read_from(uint32_t seq, int resp_size)
+{
+	struct ec_params_console_read_v1 p;
+
+	p.seq = seq;
+	memset(&resp, 0xff, sizeof(resp));
+	return test_send_host_command(EC_CMD_CONSOLE_READ, 1, &p, sizeof(p),
+				      &resp, resp_size);
+}
+
+/* Return the sequence number after all complete lines */
+static uint32_t read_end(void)
+{
+	uint32_t seq = 0;
+
+	do {
+		read_from(seq, sizeof(resp));
+		seq = resp.r.next_seq;
+	} while (resp.data[0]);
+
+	return seq;
+}
+
+/* Finish any partial line, and return the sequence number after it */
+static uint32_t start_line(void)
+{
+	uart_puts("\n");
+	cflush();
+	return read_end();
+}
+
+static int test_whole_lines(void)
+{
+	uint32_t seq;
+
+	seq = start_line();
+
+	/* A partial line isn't returned until it's finished */
+	uart_puts("hello\nwor");
+	TEST_ASSERT(read_from(seq, sizeof(resp)) == EC_RES_SUCCESS);
+	TEST_ASSERT(resp.r.seq == seq);
+	TEST_ASSERT(resp.r.next_seq == seq + 7);
+	TEST_ASSERT_ARRAY_EQ(resp.data, "hello\r\n", 8);
+
+	uart_puts("ld\n");
+	seq = resp.r.next_seq;
+	TEST_ASSERT(read_from(seq, sizeof(resp)) == EC_RES_SUCCESS);
+	TEST_ASSERT(resp.r.seq == seq);
+	TEST_ASSERT(resp.r.next_seq == seq + 7);
+	TEST_ASSERT_ARRAY_EQ(resp.data, "world\r\n", 8);
+
+	/* Nothing new */
+	seq = resp.r.next_seq;
+	TEST_ASSERT(read_from(seq, sizeof(resp)) == EC_RES_SUCCESS);
+	TEST_ASSERT(resp.r.next_seq == seq);
+	TEST_ASSERT(resp.data[0] == '\0');
+	cflush();
+
+	return EC_SUCCESS;
+}
+
+static int test_long_line(void)
+{
+	int size = sizeof(resp.r) + 5;
+	uint32_t seq;
+
+	seq = start_line();
+
+	/* A line longer than the response is returned in pieces */
+	uart_puts("abcdefgh\n");
+	TEST_ASSERT(read_from(seq, size) == EC_RES_SUCCESS);
+	TEST_ASSERT(resp.r.next_seq == seq + 4);
+	TEST_ASSERT_ARRAY_EQ(resp.data, "abcd", 5);
+
+	TEST_ASSERT(read_from(seq + 4, size) == EC_RES_SUCCESS);
+	TEST_ASSERT(resp.r.next_seq == seq + 8);
+	TEST_ASSERT_ARRAY_EQ(resp.data, "efgh", 5);
+
+	/* Whole lines are preferred to filling the response */
+	uart_puts("ij\nkl\n");
+	TEST_ASSERT(read_from(seq + 8, size) == EC_RES_SUCCESS);
+	TEST_ASSERT(resp.r.next_seq == seq + 10);
+	TEST_ASSERT_ARRAY_EQ(resp.data, "\r\n", 3);
+
+	TEST_ASSERT(read_from(seq + 10, size) == EC_RES_SUCCESS);
+	TEST_ASSERT(resp.r.next_seq == seq + 14);
+	TEST_ASSERT_ARRAY_EQ(resp.data, "ij\r\n", 5);
+	cflush();
+
+	return EC_SUCCESS;
+}
+
+static int test_lost(void)
+{
+	uint32_t seq, end;
+	int i;
+
+	/* Overwrite the whole buffer */
+	seq = start_line();
+	for (i = 0; i < CONFIG_UART_TX_BUF_SIZE / 8; i++) {
+		uart_printf("line %02d\n", i);
+		cflush();
+	}
+	end = read_end();
+	TEST_ASSERT(end - seq >= CONFIG_UART_TX_BUF_SIZE);
+
+	/* Reading restarts at the oldest whole line */
+	TEST_ASSERT(read_from(seq, sizeof(resp)) == EC_RES_SUCCESS);
+	TEST_ASSERT(resp.r.seq != seq);
+	TEST_ASSERT(end - resp.r.seq < CONFIG_UART_TX_BUF_SIZE);
+	TEST_ASSERT(resp.r.next_seq == end);
+	TEST_ASSERT_ARRAY_EQ(resp.data, "line ", 5);
+
+	/* So does a sequence number from the future, like after a reboot */
+	TEST_ASSERT(read_from(end + 1000, sizeof(resp)) == EC_RES_SUCCESS);
+	TEST_ASSERT(resp.r.next_seq == end);
+	TEST_ASSERT_ARRAY_EQ(resp.data, "line ", 5);
+
+	return EC_SUCCESS;
+}
+
+void run_test(void)
+{
+	test_reset();
+
+	/* Host command debug output would mix with the output under test */
+	UART_INJECT("hcdebug off\n");
+	msleep(30);
+
+	RUN_TEST(test_whole_lines);
+	RUN_TEST(test_long_line);
+	RUN_TEST(test_lost);
+
+	test_print_result();
+}
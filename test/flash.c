@@ -6,8 +6,12 @@
 /* Console commands to trigger flash host commands */
 
 #include "console.h"
+#include "ec_crc32.h"
 #include "ec_commands.h"
 #include "flash.h"
+#ifdef EMU_BUILD
+#include "flash_timing.h"
+#endif
 #include "gpio.h"
 #include "hooks.h"
 #include "host_command.h"
@@ -187,6 +191,47 @@ int host_command_read(int offset, int size, char *out)
 				      sizeof(params), out, size);
 }
 
+int host_command_read_multi(const struct ec_params_flash_read *region,
+			   int count, char *out, int size)
+{
+	uint8_t buf[128];
+	struct ec_params_flash_read_multi *params =
+		(struct ec_params_flash_read_multi *)buf;
+
+	params->count = count;
+	memcpy(params->region, region, count * sizeof(*region));
+
+	return test_send_host_command(EC_CMD_FLASH_READ,
+				      EC_VER_FLASH_READ_MULTI, buf,
+				      sizeof(*params) +
+				      count * sizeof(*region), out, size);
+}
+
+int host_command_block_crc(int offset, int block_size, int count,
+			   uint32_t *crc)
+{
+	struct ec_params_flash_block_crc params;
+
+	params.offset = offset;
+	params.block_size = block_size;
+	params.count = count;
+
+	return test_send_host_command(EC_CMD_FLASH_BLOCK_CRC, 0, &params,
+				      sizeof(params), crc,
+				      count * sizeof(*crc));
+}
+
+int host_command_erased_map(int offset, int count, uint8_t *map)
+{
+	struct ec_params_flash_erased_map params;
+
+	params.offset = offset;
+	params.count = count;
+
+	return test_send_host_command(EC_CMD_FLASH_ERASED_MAP, 0, &params,
+				      sizeof(params), map, (count + 7) / 8);
+}
+
 int host_command_write(int offset, int size, const char *data)
 {
 	uint8_t buf[256];
@@ -278,6 +323,82 @@ static int test_read(void)
 	return EC_SUCCESS;
 }
 
+static int test_read_multi(void)
+{
+	const struct ec_params_flash_read region[] = {
+		{ .offset = 0x10, .size = 4 },
+		{ .offset = 0x100, .size = 8 },
+		{ .offset = 0x2, .size = 3 },
+	};
+	struct ec_params_flash_read many[EC_FLASH_READ_MULTI_MAX + 1];
+	const char *flash = (const char *)CONFIG_FLASH_BASE;
+	char buf[15];
+
+	TEST_ASSERT(host_command_read_multi(region, ARRAY_SIZE(region), buf,
+					    sizeof(buf)) == EC_RES_SUCCESS);
+	TEST_ASSERT_ARRAY_EQ(buf, flash + 0x10, 4);
+	TEST_ASSERT_ARRAY_EQ(buf + 4, flash + 0x100, 8);
+	TEST_ASSERT_ARRAY_EQ(buf + 12, flash + 0x2, 3);
+
+	/* Region past the end of flash */
+	many[0].offset = CONFIG_FLASH_SIZE - 2;
+	many[0].size = 4;
+	TEST_ASSERT(host_command_read_multi(many, 1, buf, sizeof(buf)) ==
+		    EC_RES_ERROR);
+
+	/* Too many regions */
+	memset(many, 0, sizeof(many));
+	TEST_ASSERT(host_command_read_multi(many, ARRAY_SIZE(many), buf,
+					    sizeof(buf)) ==
+		    EC_RES_INVALID_PARAM);
+
+	return EC_SUCCESS;
+}
+
+static int test_block_crc(void)
+{
+	const char *flash = (const char *)CONFIG_FLASH_BASE;
+	uint32_t crc[4];
+	int i;
+
+	TEST_ASSERT(host_command_block_crc(0, 0x100, ARRAY_SIZE(crc), crc) ==
+		    EC_RES_SUCCESS);
+	for (i = 0; i < ARRAY_SIZE(crc); i++)
+		TEST_ASSERT(crc[i] == ec_crc32_add(0, flash + i * 0x100,
+						   0x100));
+
+	/* Standard check value */
+	TEST_ASSERT(ec_crc32_add(0, "123456789", 9) == 0xcbf43926);
+
+	/* Blocks past the end of flash */
+	TEST_ASSERT(host_command_block_crc(CONFIG_FLASH_SIZE - 0x100, 0x100,
+					   2, crc) == EC_RES_ERROR);
+	TEST_ASSERT(host_command_block_crc(0, 0, 1, crc) ==
+		    EC_RES_INVALID_PARAM);
+
+	return EC_SUCCESS;
+}
+
+static int test_erased_map(void)
+{
+	const int offset = CONFIG_FLASH_SIZE - 4 * CONFIG_FLASH_ERASE_SIZE;
+	uint8_t map;
+
+	/*
+	 * Flash writes and erases are mocked here; the map itself is tested
+	 * by the flash_erase_map test.
+	 */
+	TEST_ASSERT(host_command_erased_map(offset, 4, &map) ==
+		    EC_RES_SUCCESS);
+
+	/* Blocks past the end of flash, or not aligned */
+	TEST_ASSERT(host_command_erased_map(offset, 5, &map) == EC_RES_ERROR);
+	TEST_ASSERT(host_command_erased_map(offset + 4, 1, &map) ==
+		    EC_RES_ERROR);
+
+	return EC_SUCCESS;
+}
+
 static int test_overwrite_current(void)
 {
 	uint32_t offset, size;
@@ -355,6 +476,105 @@ static int test_flash_info(void)
 		   (resp.protect_block_size == CONFIG_FLASH_BANK_SIZE));
 }
 
+#ifdef CONFIG_FLASH_STATS
+/* Count the writes and erases in the latency histograms */
+static void count_ops(const struct ec_response_flash_info_2 *r,
+		      int *writes, int *erases)
+{
+	int i;
+
+	*writes = *erases = 0;
+	for (i = 0; i < EC_FLASH_STATS_BUCKETS; i++) {
+		*writes += r->write_hist[i];
+		*erases += r->erase_hist[i];
+	}
+}
+
+static int test_flash_stats(void)
+{
+	struct ec_response_flash_info_2 before, after;
+	int writes_before, erases_before, writes, erases;
+
+	TEST_ASSERT(flash_protect_ro_at_boot(0) == EC_SUCCESS);
+	TEST_ASSERT(test_send_host_command(EC_CMD_FLASH_INFO, 2, NULL, 0,
+		    &before, sizeof(before)) == EC_RES_SUCCESS);
+	TEST_ASSERT(before.flash_size == CONFIG_FLASH_SIZE);
+
+	/* Each change rewrites pstate, erasing its bank */
+	TEST_ASSERT(flash_protect_ro_at_boot(1) == EC_SUCCESS);
+	TEST_ASSERT(flash_protect_ro_at_boot(0) == EC_SUCCESS);
+
+	TEST_ASSERT(test_send_host_command(EC_CMD_FLASH_INFO, 2, NULL, 0,
+		    &after, sizeof(after)) == EC_RES_SUCCESS);
+	count_ops(&before, &writes_before, &erases_before);
+	count_ops(&after, &writes, &erases);
+	TEST_ASSERT(erases == erases_before + 2);
+	TEST_ASSERT(writes >= writes_before + 2);
+	TEST_ASSERT(after.erase_count_total >= before.erase_count_total + 1);
+	TEST_ASSERT(after.erase_count_max >= 1);
+
+	return EC_SUCCESS;
+}
+#endif
+
+#ifdef EMU_BUILD
+static int deferred_ran;
+
+static void timing_deferred(void)
+{
+	deferred_ran = 1;
+}
+DECLARE_DEFERRED(timing_deferred);
+
+static int test_flash_timing(void)
+{
+	const int offset = CONFIG_FLASH_SIZE - 2 * CONFIG_FLASH_ERASE_SIZE;
+	struct flash_timing timing = {
+		.write_ns_per_byte = 500,
+		.erase_us_per_block = 20 * MSEC,
+		.wait = FLASH_TIMING_BUSY,
+	};
+	uint64_t t;
+
+	/* Busy-waiting takes exactly the modeled time */
+	flash_set_timing(&timing);
+	t = get_time().val;
+	TEST_ASSERT(flash_physical_erase(offset, 2 * CONFIG_FLASH_ERASE_SIZE) ==
+		    EC_SUCCESS);
+	TEST_ASSERT(get_time().val - t == 40 * MSEC);
+	t = get_time().val;
+	TEST_ASSERT(flash_physical_write(offset, 16, testdata) == EC_SUCCESS);
+	TEST_ASSERT(get_time().val - t == 8);
+
+	/* Sleeping lets other tasks run while flash is busy */
+	timing.wait = FLASH_TIMING_SLEEP;
+	flash_set_timing(&timing);
+	deferred_ran = 0;
+	hook_call_deferred(timing_deferred, 0);
+	t = get_time().val;
+	TEST_ASSERT(flash_physical_erase(offset, CONFIG_FLASH_ERASE_SIZE) ==
+		    EC_SUCCESS);
+	TEST_ASSERT(get_time().val - t >= 20 * MSEC);
+	TEST_ASSERT(deferred_ran);
+
+#ifdef CONFIG_FLASH_STATS
+	/* Stats see the time pstate rewrites take */
+	{
+		struct ec_response_flash_info_2 r;
+
+		TEST_ASSERT(flash_protect_ro_at_boot(1) == EC_SUCCESS);
+		TEST_ASSERT(flash_protect_ro_at_boot(0) == EC_SUCCESS);
+		TEST_ASSERT(test_send_host_command(EC_CMD_FLASH_INFO, 2,
+			    NULL, 0, &r, sizeof(r)) == EC_RES_SUCCESS);
+		TEST_ASSERT(r.erase_max_us >= 20 * MSEC);
+	}
+#endif
+
+	flash_set_timing(NULL);
+	return EC_SUCCESS;
+}
+#endif
+
 static int test_region_info(void)
 {
 	VERIFY_REGION_INFO(EC_FLASH_REGION_RO,
@@ -451,11 +671,20 @@ static void run_test_step1(void)
 	mock_wp = 0;
 
 	RUN_TEST(test_read);
+	RUN_TEST(test_read_multi);
+	RUN_TEST(test_block_crc);
+	RUN_TEST(test_erased_map);
 	RUN_TEST(test_overwrite_current);
 	RUN_TEST(test_overwrite_other);
 	RUN_TEST(test_op_failure);
 	RUN_TEST(test_flash_info);
 	RUN_TEST(test_region_info);
+#ifdef CONFIG_FLASH_STATS
+	RUN_TEST(test_flash_stats);
+#endif
+#ifdef EMU_BUILD
+	RUN_TEST(test_flash_timing);
+#endif
 	RUN_TEST(test_write_protect);
 
 	if (test_get_error_count())
@@ -0,0 +1,85 @@
+/* Copyright (c) 2013 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Test the erased block map follows flash writes and erases.
+ */
+
+#include "common.h"
+#include "console.h"
+#include "ec_commands.h"
+#include "flash.h"
+#include "host_command.h"
+#include "test_util.h"
+#include "util.h"
+
+#define BLOCK CONFIG_FLASH_ERASE_SIZE
+#define RW_OFFSET CONFIG_FW_RW_OFF
+#define RO_OFFSET CONFIG_FW_RO_OFF
+
+static const char data[4] = {1, 2, 3, 4};
+
+static int get_erased_map(int offset, int count, uint8_t *map)
+{
+	struct ec_params_flash_erased_map params;
+
+	params.offset = offset;
+	params.count = count;
+
+	return test_send_host_command(EC_CMD_FLASH_ERASED_MAP, 0, &params,
+				      sizeof(params), map, (count + 7) / 8);
+}
+
+static int test_erase_write(void)
+{
+	uint8_t map;
+
+	TEST_ASSERT(flash_erase(RW_OFFSET, 4 * BLOCK) == EC_SUCCESS);
+	TEST_ASSERT(get_erased_map(RW_OFFSET, 4, &map) == EC_RES_SUCCESS);
+	TEST_ASSERT(map == 0x0f);
+
+	/* Writing clears the block's bit */
+	TEST_ASSERT(flash_write(RW_OFFSET + BLOCK + 8, sizeof(data), data) ==
+		    EC_SUCCESS);
+	TEST_ASSERT(get_erased_map(RW_OFFSET, 4, &map) == EC_RES_SUCCESS);
+	TEST_ASSERT(map == 0x0d);
+
+	/* Erasing sets it again */
+	TEST_ASSERT(flash_erase(RW_OFFSET + BLOCK, BLOCK) == EC_SUCCESS);
+	TEST_ASSERT(get_erased_map(RW_OFFSET, 4, &map) == EC_RES_SUCCESS);
+	TEST_ASSERT(map == 0x0f);
+
+	return EC_SUCCESS;
+}
+
+static int test_failed_erase(void)
+{
+	uint8_t map;
+
+	TEST_ASSERT(flash_erase(RO_OFFSET, 2 * BLOCK) == EC_SUCCESS);
+	TEST_ASSERT(get_erased_map(RO_OFFSET, 2, &map) == EC_RES_SUCCESS);
+	TEST_ASSERT(map == 0x03);
+
+	/* The map is cached, so doesn't see flash changed behind its back */
+	__host_flash[RO_OFFSET + 5] = 0;
+	TEST_ASSERT(get_erased_map(RO_OFFSET, 2, &map) == EC_RES_SUCCESS);
+	TEST_ASSERT(map == 0x03);
+
+	/* A failed erase forgets the blocks, so they're scanned again */
+	TEST_ASSERT(flash_physical_protect_now(0) == EC_SUCCESS);
+	TEST_ASSERT(flash_erase(RO_OFFSET, 2 * BLOCK) != EC_SUCCESS);
+	TEST_ASSERT(get_erased_map(RO_OFFSET, 2, &map) == EC_RES_SUCCESS);
+	TEST_ASSERT(map == 0x02);
+
+	return EC_SUCCESS;
+}
+
+void run_test(void)
+{
+	test_reset();
+
+	RUN_TEST(test_erase_write);
+	RUN_TEST(test_failed_erase);
+
+	test_print_result();
+}
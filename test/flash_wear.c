@@ -0,0 +1,97 @@
+/* Copyright (c) 2013 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Test flash wear records persist across reboots.
+ */
+
+#include "common.h"
+#include "console.h"
+#include "ec_commands.h"
+#include "flash.h"
+#include "host_command.h"
+#include "system.h"
+#include "test_util.h"
+#include "timer.h"
+#include "util.h"
+
+#define TEST_STATE_STEP_2	(1 << 0)
+#define TEST_STATE_FAIL		(1 << 1)
+#define TEST_STATE_COUNT_SHIFT	8
+
+#define TEST_OFFSET (CONFIG_FLASH_SIZE - CONFIG_FLASH_ERASE_SIZE)
+
+/* Longer than the delay before the wear record is saved */
+#define SAVE_WAIT_MS 2500
+
+static const char data[4] = {1, 2, 3, 4};
+
+static int get_erase_count(uint32_t *count)
+{
+	struct ec_response_flash_info_2 r;
+
+	if (test_send_host_command(EC_CMD_FLASH_INFO, 2, NULL, 0, &r,
+				   sizeof(r)) != EC_RES_SUCCESS)
+		return EC_ERROR_UNKNOWN;
+	*count = r.erase_count_total;
+	return EC_SUCCESS;
+}
+
+static int test_save_after_pstate_erase(void)
+{
+	uint32_t count;
+
+	/* Save a record, so later ones don't go in the first slot */
+	TEST_ASSERT(flash_erase(PSTATE_OFFSET, PSTATE_SIZE) == EC_SUCCESS);
+	TEST_ASSERT(flash_write(TEST_OFFSET, sizeof(data), data) == EC_SUCCESS);
+	TEST_ASSERT(flash_erase(TEST_OFFSET, CONFIG_FLASH_ERASE_SIZE) ==
+		    EC_SUCCESS);
+	msleep(SAVE_WAIT_MS);
+
+	/* Erasing the pstate bank directly wipes the saved records */
+	TEST_ASSERT(flash_erase(PSTATE_OFFSET, PSTATE_SIZE) == EC_SUCCESS);
+	TEST_ASSERT(flash_write(TEST_OFFSET, sizeof(data), data) == EC_SUCCESS);
+	TEST_ASSERT(flash_erase(TEST_OFFSET, CONFIG_FLASH_ERASE_SIZE) ==
+		    EC_SUCCESS);
+	msleep(SAVE_WAIT_MS);
+
+	TEST_ASSERT(get_erase_count(&count) == EC_SUCCESS);
+	TEST_ASSERT(count >= 2);
+
+	/* Reboot and check the counts were saved */
+	ccprintf("Rebooting...\n");
+	cflush();
+	system_set_scratchpad(TEST_STATE_STEP_2 |
+			      (count << TEST_STATE_COUNT_SHIFT));
+	system_reset(SYSTEM_RESET_HARD);
+
+	/* Shouldn't reach here */
+	return EC_ERROR_UNKNOWN;
+}
+
+static int test_count_after_reboot(void)
+{
+	uint32_t count;
+
+	TEST_ASSERT(get_erase_count(&count) == EC_SUCCESS);
+	TEST_ASSERT(count ==
+		    system_get_scratchpad() >> TEST_STATE_COUNT_SHIFT);
+
+	return EC_SUCCESS;
+}
+
+void run_test(void)
+{
+	uint32_t state = system_get_scratchpad();
+
+	test_reset();
+
+	if (state & TEST_STATE_STEP_2)
+		RUN_TEST(test_count_after_reboot);
+	else
+		RUN_TEST(test_save_after_pstate_erase);
+
+	/* Step 1 only gets here if it failed before rebooting */
+	system_set_scratchpad(0);
+	test_print_result();
+}
@@ -0,0 +1,156 @@
+/* Copyright (c) 2013 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Test flash write combining.
+ */
+
+#include "common.h"
+#include "console.h"
+#include "flash.h"
+#include "test_util.h"
+#include "timer.h"
+#include "util.h"
+
+#define TEST_OFFSET CONFIG_FW_RW_OFF
+#define IDEAL CONFIG_FLASH_WRITE_IDEAL_SIZE
+
+static char data[IDEAL * 3];
+
+/* Return non-zero if raw flash matches data, bypassing the buffer */
+static int raw_matches(int offset, int data_offset, int size)
+{
+	return !memcmp(__host_flash + offset, data + data_offset, size);
+}
+
+/* Return non-zero if raw flash is erased, bypassing the buffer */
+static int raw_erased(int offset, int size)
+{
+	while (size--)
+		if (__host_flash[offset++] != (char)0xff)
+			return 0;
+	return 1;
+}
+
+static int test_combine(void)
+{
+	TEST_ASSERT(flash_write(TEST_OFFSET, 4, data) == EC_SUCCESS);
+	TEST_ASSERT(flash_write(TEST_OFFSET + 4, 4, data + 4) == EC_SUCCESS);
+
+	/* Nothing programmed until the buffer is flushed */
+	TEST_ASSERT(raw_erased(TEST_OFFSET, 8));
+	TEST_ASSERT(flash_write_flush() == EC_SUCCESS);
+	TEST_ASSERT(raw_matches(TEST_OFFSET, 0, 8));
+
+	return EC_SUCCESS;
+}
+
+static int test_fill_window(void)
+{
+	int i;
+
+	/* Filling up to the ideal size boundary programs the buffer */
+	for (i = 0; i < IDEAL; i += 8)
+		TEST_ASSERT(flash_write(TEST_OFFSET + i, 8, data + i) ==
+			    EC_SUCCESS);
+	TEST_ASSERT(raw_matches(TEST_OFFSET, 0, IDEAL));
+
+	return EC_SUCCESS;
+}
+
+static int test_not_adjacent(void)
+{
+	TEST_ASSERT(flash_write(TEST_OFFSET, 4, data) == EC_SUCCESS);
+	TEST_ASSERT(flash_write(TEST_OFFSET + 16, 4, data + 16) == EC_SUCCESS);
+
+	/* The first write was flushed; the second is still buffered */
+	TEST_ASSERT(raw_matches(TEST_OFFSET, 0, 4));
+	TEST_ASSERT(raw_erased(TEST_OFFSET + 16, 4));
+	TEST_ASSERT(flash_write_flush() == EC_SUCCESS);
+	TEST_ASSERT(raw_matches(TEST_OFFSET + 16, 16, 4));
+
+	return EC_SUCCESS;
+}
+
+static int test_unaligned_large(void)
+{
+	/* Starts mid-window and spans several windows */
+	TEST_ASSERT(flash_write(TEST_OFFSET + 8, IDEAL * 2, data + 8) ==
+		    EC_SUCCESS);
+
+	/* Only the tail past the last full window is still buffered */
+	TEST_ASSERT(raw_matches(TEST_OFFSET + 8, 8, IDEAL * 2 - 8));
+	TEST_ASSERT(raw_erased(TEST_OFFSET + IDEAL * 2, 8));
+	TEST_ASSERT(flash_write_flush() == EC_SUCCESS);
+	TEST_ASSERT(raw_matches(TEST_OFFSET + 8, 8, IDEAL * 2));
+
+	return EC_SUCCESS;
+}
+
+static int test_dataptr_flushes(void)
+{
+	const char *ptr;
+
+	TEST_ASSERT(flash_write(TEST_OFFSET, 4, data) == EC_SUCCESS);
+	TEST_ASSERT(flash_dataptr(TEST_OFFSET, 4, 1, &ptr) > 0);
+	TEST_ASSERT(!memcmp(ptr, data, 4));
+
+	return EC_SUCCESS;
+}
+
+static int test_erase_after_write(void)
+{
+	TEST_ASSERT(flash_write(TEST_OFFSET, 4, data) == EC_SUCCESS);
+	TEST_ASSERT(flash_erase(TEST_OFFSET, CONFIG_FLASH_ERASE_SIZE) ==
+		    EC_SUCCESS);
+
+	/* The buffered write must not land after the erase */
+	TEST_ASSERT(flash_write_flush() == EC_SUCCESS);
+	TEST_ASSERT(raw_erased(TEST_OFFSET, 4));
+
+	return EC_SUCCESS;
+}
+
+static int test_deferred_flush(void)
+{
+	TEST_ASSERT(flash_write(TEST_OFFSET, 4, data) == EC_SUCCESS);
+	TEST_ASSERT(raw_erased(TEST_OFFSET, 4));
+
+	/* A partial buffer is flushed on its own after a while */
+	msleep(50);
+	TEST_ASSERT(raw_matches(TEST_OFFSET, 0, 4));
+
+	return EC_SUCCESS;
+}
+
+static void reset_flash(void)
+{
+	flash_erase(TEST_OFFSET, CONFIG_FLASH_ERASE_SIZE);
+}
+
+void run_test(void)
+{
+	int i;
+
+	test_reset();
+
+	for (i = 0; i < sizeof(data); i++)
+		data[i] = i * 7 + 3;
+
+	reset_flash();
+	RUN_TEST(test_combine);
+	reset_flash();
+	RUN_TEST(test_fill_window);
+	reset_flash();
+	RUN_TEST(test_not_adjacent);
+	reset_flash();
+	RUN_TEST(test_unaligned_large);
+	reset_flash();
+	RUN_TEST(test_dataptr_flushes);
+	reset_flash();
+	RUN_TEST(test_erase_after_write);
+	reset_flash();
+	RUN_TEST(test_deferred_flush);
+
+	test_print_result();
+}
@@ -0,0 +1,542 @@
+/* Copyright (c) 2013 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Test host command queueing, batching, checksums, statistics and
+ * in-progress responses.
+ */
+
+#include "common.h"
+#include "console.h"
+#include "ec_checksum.h"
+#include "ec_commands.h"
+#include "host_command.h"
+#include "task.h"
+#include "test_util.h"
+#include "timer.h"
+#include "util.h"
+
+/* One more packet than the EC can hold in flight */
+#define TEST_PACKETS (CONFIG_HOST_COMMAND_QUEUE_SIZE + 1)
+
+struct test_packet {
+	struct host_packet pkt;
+	struct {
+		struct ec_host_request hdr;
+		struct ec_params_hello p;
+	} __packed req;
+	struct {
+		struct ec_host_response hdr;
+		struct ec_response_hello r;
+	} __packed resp;
+};
+
+static struct test_packet packets[TEST_PACKETS];
+
+/* Order in which responses were sent */
+static int resp_order[TEST_PACKETS];
+static int resp_count;
+
+static void packet_respond(struct host_packet *pkt)
+{
+	resp_order[resp_count++] = (struct test_packet *)pkt - packets;
+}
+
+static uint8_t checksum(const void *data, int size)
+{
+	const uint8_t *d = data;
+	uint8_t csum = 0;
+
+	while (size--)
+		csum += *d++;
+	return csum;
+}
+
+static void send_hello(int i)
+{
+	struct test_packet *tp = packets + i;
+
+	memset(tp, 0, sizeof(*tp));
+	tp->req.hdr.struct_version = EC_HOST_REQUEST_VERSION;
+	tp->req.hdr.command = EC_CMD_HELLO;
+	tp->req.hdr.data_len = sizeof(tp->req.p);
+	tp->req.p.in_data = i;
+	tp->req.hdr.checksum = -checksum(&tp->req, sizeof(tp->req));
+
+	tp->pkt.send_response = packet_respond;
+	tp->pkt.request = &tp->req;
+	tp->pkt.request_max = sizeof(tp->req);
+	tp->pkt.request_size = sizeof(tp->req);
+	tp->pkt.response = &tp->resp;
+	tp->pkt.response_max = sizeof(tp->resp);
+
+	host_packet_receive(&tp->pkt);
+}
+
+static int check_hello_response(int i)
+{
+	struct test_packet *tp = packets + i;
+
+	TEST_ASSERT(tp->resp.hdr.result == EC_RES_SUCCESS);
+	TEST_ASSERT(tp->resp.hdr.data_len == sizeof(tp->resp.r));
+	TEST_ASSERT(tp->pkt.response_size == sizeof(tp->resp));
+	TEST_ASSERT(checksum(&tp->resp, sizeof(tp->resp)) == 0);
+	TEST_ASSERT(tp->resp.r.out_data == i + 0x01020304);
+
+	return EC_SUCCESS;
+}
+
+static int test_queue_order(void)
+{
+	int i;
+
+	resp_count = 0;
+	for (i = 0; i < CONFIG_HOST_COMMAND_QUEUE_SIZE; i++)
+		send_hello(i);
+
+	/* Host command task hasn't run yet */
+	TEST_ASSERT(resp_count == 0);
+
+	msleep(10);
+
+	TEST_ASSERT(resp_count == CONFIG_HOST_COMMAND_QUEUE_SIZE);
+	for (i = 0; i < CONFIG_HOST_COMMAND_QUEUE_SIZE; i++) {
+		TEST_ASSERT(resp_order[i] == i);
+		TEST_ASSERT(check_hello_response(i) == EC_SUCCESS);
+	}
+
+	return EC_SUCCESS;
+}
+
+static int test_queue_full(void)
+{
+	int i;
+
+	resp_count = 0;
+	for (i = 0; i < TEST_PACKETS; i++)
+		send_hello(i);
+
+	/* The packet which didn't fit is rejected right away */
+	TEST_ASSERT(resp_count == 1);
+	TEST_ASSERT(resp_order[0] == TEST_PACKETS - 1);
+	TEST_ASSERT(packets[TEST_PACKETS - 1].resp.hdr.result == EC_RES_BUSY);
+	TEST_ASSERT(packets[TEST_PACKETS - 1].resp.hdr.data_len == 0);
+
+	msleep(10);
+
+	TEST_ASSERT(resp_count == TEST_PACKETS);
+	for (i = 1; i < TEST_PACKETS; i++) {
+		TEST_ASSERT(resp_order[i] == i - 1);
+		TEST_ASSERT(check_hello_response(i - 1) == EC_SUCCESS);
+	}
+
+	/* Slots are free again */
+	resp_count = 0;
+	send_hello(0);
+	msleep(10);
+	TEST_ASSERT(resp_count == 1);
+	TEST_ASSERT(check_hello_response(0) == EC_SUCCESS);
+
+	return EC_SUCCESS;
+}
+
+static int args_responses;
+
+static void args_respond(struct host_cmd_handler_args *args)
+{
+	args_responses++;
+}
+
+static int test_duplicate(void)
+{
+	struct host_cmd_handler_args args;
+	struct ec_response_proto_version r;
+
+	args.send_response = args_respond;
+	args.command = EC_CMD_PROTO_VERSION;
+	args.version = 0;
+	args.params = NULL;
+	args.params_size = 0;
+	args.response = &r;
+	args.response_max = sizeof(r);
+	args.response_size = 0;
+	args.result = EC_RES_SUCCESS;
+
+	args_responses = 0;
+	host_command_received(&args);
+	host_command_received(&args);
+	msleep(10);
+
+	/* The second submission was ignored */
+	TEST_ASSERT(args_responses == 1);
+	TEST_ASSERT(args.result == EC_RES_SUCCESS);
+	TEST_ASSERT(r.version == EC_PROTO_VERSION);
+
+	return EC_SUCCESS;
+}
+
+/* Append a sub-request to a batch; returns the new end of the params */
+static uint8_t *batch_add(uint8_t *out, int command, const void *params,
+			  int params_size)
+{
+	struct ec_params_batch_cmd *req = (struct ec_params_batch_cmd *)out;
+
+	req->command = command;
+	req->command_version = 0;
+	req->data_len = params_size;
+	memcpy(req + 1, params, params_size);
+	memset((uint8_t *)(req + 1) + params_size, 0,
+	       EC_BATCH_PAD(sizeof(*req) + params_size) - sizeof(*req) -
+	       params_size);
+
+	return out + EC_BATCH_PAD(sizeof(*req) + params_size);
+}
+
+static uint8_t batch_params[128] __aligned(4);
+static uint8_t batch_resp[128] __aligned(4);
+
+static int test_batch(void)
+{
+	struct ec_params_batch *p = (struct ec_params_batch *)batch_params;
+	struct ec_response_batch *r = (struct ec_response_batch *)batch_resp;
+	struct ec_response_batch_cmd *resp;
+	struct ec_params_hello hello = { .in_data = 0x10 };
+	struct ec_response_hello *hello_r;
+	struct ec_response_proto_version *proto_r;
+	uint8_t *out = (uint8_t *)(p + 1);
+	uint8_t *in;
+
+	p->count = 3;
+	p->flags = 0;
+	out = batch_add(out, EC_CMD_HELLO, &hello, sizeof(hello));
+	out = batch_add(out, EC_CMD_BATCH, NULL, 0);
+	out = batch_add(out, EC_CMD_PROTO_VERSION, NULL, 0);
+
+	memset(batch_resp, 0xff, sizeof(batch_resp));
+	TEST_ASSERT(test_send_host_command(EC_CMD_BATCH, 0, batch_params,
+					   out - batch_params, batch_resp,
+					   sizeof(batch_resp)) ==
+		    EC_RES_SUCCESS);
+	TEST_ASSERT(r->count == 3);
+
+	in = (uint8_t *)(r + 1);
+	resp = (struct ec_response_batch_cmd *)in;
+	hello_r = (struct ec_response_hello *)(resp + 1);
+	TEST_ASSERT(resp->result == EC_RES_SUCCESS);
+	TEST_ASSERT(resp->data_len == sizeof(*hello_r));
+	TEST_ASSERT(hello_r->out_data == 0x01020314);
+
+	/* Nested batches are rejected */
+	in += EC_BATCH_PAD(sizeof(*resp) + resp->data_len);
+	resp = (struct ec_response_batch_cmd *)in;
+	TEST_ASSERT(resp->result == EC_RES_INVALID_COMMAND);
+	TEST_ASSERT(resp->data_len == 0);
+
+	in += EC_BATCH_PAD(sizeof(*resp) + resp->data_len);
+	resp = (struct ec_response_batch_cmd *)in;
+	proto_r = (struct ec_response_proto_version *)(resp + 1);
+	TEST_ASSERT(resp->result == EC_RES_SUCCESS);
+	TEST_ASSERT(resp->data_len == sizeof(*proto_r));
+	TEST_ASSERT(proto_r->version == EC_PROTO_VERSION);
+
+	/* Stop at the first error if asked to */
+	p->flags = EC_BATCH_FLAG_STOP_ON_ERROR;
+	TEST_ASSERT(test_send_host_command(EC_CMD_BATCH, 0, batch_params,
+					   out - batch_params, batch_resp,
+					   sizeof(batch_resp)) ==
+		    EC_RES_SUCCESS);
+	TEST_ASSERT(r->count == 2);
+
+	/* Truncated sub-request */
+	p->flags = 0;
+	TEST_ASSERT(test_send_host_command(EC_CMD_BATCH, 0, batch_params,
+					   out - batch_params - 1, batch_resp,
+					   sizeof(batch_resp)) ==
+		    EC_RES_INVALID_PARAM);
+
+	return EC_SUCCESS;
+}
+
+static int test_bad_checksum(void)
+{
+	struct test_packet *tp = packets;
+
+	resp_count = 0;
+	send_hello(0);
+	msleep(10);
+	TEST_ASSERT(resp_count == 1);
+
+	/* Resend with a corrupted param byte */
+	tp->req.p.in_data ^= 0x100;
+	resp_count = 0;
+	host_packet_receive(&tp->pkt);
+	TEST_ASSERT(resp_count == 1);
+	TEST_ASSERT(tp->resp.hdr.result == EC_RES_INVALID_CHECKSUM);
+	TEST_ASSERT(tp->resp.hdr.data_len == 0);
+	TEST_ASSERT(ec_checksum_add(0, &tp->resp.hdr,
+				    sizeof(tp->resp.hdr)) == 0);
+
+	return EC_SUCCESS;
+}
+
+static uint8_t csum_buf[2100] __aligned(4);
+
+static int test_checksum(void)
+{
+	static const int sizes[] = {0, 1, 3, 4, 5, 63, 1024, 1027, 2096};
+	int offset, i, j;
+	uint8_t expect;
+
+	/* All 0xff bytes make the word lanes overflow if not folded */
+	memset(csum_buf, 0xff, sizeof(csum_buf));
+	for (i = 0; i < 1000; i++)
+		csum_buf[i] = i * 7 + 3;
+
+	for (offset = 0; offset < 4; offset++) {
+		for (i = 0; i < ARRAY_SIZE(sizes); i++) {
+			expect = 0x5a;
+			for (j = 0; j < sizes[i]; j++)
+				expect += csum_buf[offset + j];
+			TEST_ASSERT(ec_checksum_add(0x5a, csum_buf + offset,
+						    sizes[i]) == expect);
+		}
+	}
+
+	return EC_SUCCESS;
+}
+
+static uint8_t stats_resp[256] __aligned(4);
+
+static const struct ec_hcstats_entry *find_stats(int command)
+{
+	struct ec_response_host_command_stats *r =
+		(struct ec_response_host_command_stats *)stats_resp;
+	int i;
+
+	for (i = 0; i < r->count; i++)
+		if (r->entries[i].command == command)
+			return r->entries + i;
+	return NULL;
+}
+
+static int test_stats(void)
+{
+	struct ec_params_host_command_stats p = {
+		.flags = EC_HCSTATS_FLAG_RESET
+	};
+	struct ec_response_host_command_stats *r =
+		(struct ec_response_host_command_stats *)stats_resp;
+	struct ec_params_hello hello = { .in_data = 1 };
+	struct ec_response_hello hello_r;
+	struct ec_params_test_protocol tp = { .ec_result = EC_RES_ERROR };
+	struct ec_response_test_protocol tp_r;
+	const struct ec_hcstats_entry *e;
+
+	/* Start from a clean slate */
+	TEST_ASSERT(test_send_host_command(EC_CMD_HOST_COMMAND_STATS, 0, &p,
+					   sizeof(p), stats_resp,
+					   sizeof(stats_resp)) ==
+		    EC_RES_SUCCESS);
+
+	TEST_ASSERT(test_send_host_command(EC_CMD_HELLO, 0, &hello,
+					   sizeof(hello), &hello_r,
+					   sizeof(hello_r)) == EC_RES_SUCCESS);
+	TEST_ASSERT(test_send_host_command(EC_CMD_HELLO, 0, &hello,
+					   sizeof(hello), &hello_r,
+					   sizeof(hello_r)) == EC_RES_SUCCESS);
+	TEST_ASSERT(test_send_host_command(EC_CMD_TEST_PROTOCOL, 0, &tp,
+					   sizeof(tp), &tp_r,
+					   sizeof(tp_r)) == EC_RES_ERROR);
+
+	p.flags = 0;
+	TEST_ASSERT(test_send_host_command(EC_CMD_HOST_COMMAND_STATS, 0, &p,
+					   sizeof(p), stats_resp,
+					   sizeof(stats_resp)) ==
+		    EC_RES_SUCCESS);
+
+	/* Hello, test protocol, and the reset request itself */
+	TEST_ASSERT(r->total == 3);
+	TEST_ASSERT(r->count == 3);
+	TEST_ASSERT(r->histogram[0] == 4);
+
+	e = find_stats(EC_CMD_HELLO);
+	TEST_ASSERT(e && e->calls == 2 && e->errors == 0);
+	TEST_ASSERT(e->in_progress == 0);
+	TEST_ASSERT(e->min_us == 0 && e->max_us == 0 && e->avg_us == 0);
+
+	e = find_stats(EC_CMD_TEST_PROTOCOL);
+	TEST_ASSERT(e && e->calls == 1 && e->errors == 1);
+
+	/* Paging through the entries */
+	p.offset = 2;
+	TEST_ASSERT(test_send_host_command(EC_CMD_HOST_COMMAND_STATS, 0, &p,
+					   sizeof(p), stats_resp,
+					   sizeof(stats_resp)) ==
+		    EC_RES_SUCCESS);
+	TEST_ASSERT(r->total == 3);
+	TEST_ASSERT(r->count == 1);
+
+	return EC_SUCCESS;
+}
+
+/* Test commands whose numbers aren't spelled as two lowercase hex digits */
+#define TEST_CMD_UPPER 0xDA
+#define TEST_CMD_DECIMAL 300
+
+static int test_command_echo(struct host_cmd_handler_args *args)
+{
+	uint32_t *r = args->response;
+
+	r[0] = args->command;
+	args->response_size = sizeof(uint32_t);
+	return EC_RES_SUCCESS;
+}
+DECLARE_HOST_COMMAND(TEST_CMD_UPPER, test_command_echo, EC_VER_MASK(0));
+DECLARE_HOST_COMMAND(TEST_CMD_DECIMAL, test_command_echo, EC_VER_MASK(0));
+
+static int test_lookup(void)
+{
+	uint32_t r;
+
+	TEST_ASSERT(test_send_host_command(TEST_CMD_UPPER, 0, NULL, 0,
+					   &r, sizeof(r)) == EC_RES_SUCCESS);
+	TEST_ASSERT(r == TEST_CMD_UPPER);
+	TEST_ASSERT(test_send_host_command(TEST_CMD_DECIMAL, 0, NULL, 0,
+					   &r, sizeof(r)) == EC_RES_SUCCESS);
+	TEST_ASSERT(r == TEST_CMD_DECIMAL);
+	TEST_ASSERT(test_send_host_command(EC_CMD_PROTO_VERSION, 0, NULL, 0,
+					   &r, sizeof(r)) == EC_RES_SUCCESS);
+	TEST_ASSERT(r == EC_PROTO_VERSION);
+
+	return EC_SUCCESS;
+}
+
+/* Test command which finishes after an interim response */
+#define TEST_CMD_SLOW 0xef
+
+struct test_params_slow {
+	uint32_t delay_ms;
+	uint32_t value;
+} __packed;
+
+static int test_command_slow(struct host_cmd_handler_args *args)
+{
+	const struct test_params_slow *p = args->params;
+	uint32_t delay_ms = p->delay_ms;
+	uint32_t value = p->value;
+	uint32_t *r;
+
+	args = host_command_in_progress(args);
+	msleep(delay_ms);
+
+	r = args->response;
+	r[0] = value;
+	r[1] = ~value;
+	args->response_size = 2 * sizeof(uint32_t);
+	return EC_RES_SUCCESS;
+}
+DECLARE_HOST_COMMAND(TEST_CMD_SLOW, test_command_slow, EC_VER_MASK(0));
+
+/* Packet with room for any small request and response */
+static struct {
+	struct host_packet pkt;
+	uint8_t req[64] __aligned(4);
+	uint8_t resp[64] __aligned(4);
+	int responses;
+} raw;
+
+static void raw_respond(struct host_packet *pkt)
+{
+	raw.responses++;
+}
+
+static void send_raw(int command, const void *params, int params_size)
+{
+	struct ec_host_request *r = (struct ec_host_request *)raw.req;
+
+	memset(&raw, 0, sizeof(raw));
+	r->struct_version = EC_HOST_REQUEST_VERSION;
+	r->command = command;
+	r->data_len = params_size;
+	memcpy(r + 1, params, params_size);
+	r->checksum = -checksum(r, sizeof(*r) + params_size);
+
+	raw.pkt.send_response = raw_respond;
+	raw.pkt.request = raw.req;
+	raw.pkt.request_max = sizeof(raw.req);
+	raw.pkt.request_size = sizeof(*r) + params_size;
+	raw.pkt.response = raw.resp;
+	raw.pkt.response_max = sizeof(raw.resp);
+
+	host_packet_receive(&raw.pkt);
+}
+
+static int comms_status(void)
+{
+	const struct ec_response_get_comms_status *c =
+		(const void *)(raw.resp + sizeof(struct ec_host_response));
+
+	/* Answered right away, even while a command is running */
+	send_raw(EC_CMD_GET_COMMS_STATUS, NULL, 0);
+	return raw.responses == 1 ? c->flags : -1;
+}
+
+static int test_async(void)
+{
+	struct ec_host_response *h = (struct ec_host_response *)raw.resp;
+	uint32_t *data = (uint32_t *)(h + 1);
+	struct test_params_slow p = { .delay_ms = 100, .value = 0x12345678 };
+
+	send_raw(TEST_CMD_SLOW, &p, sizeof(p));
+	msleep(10);
+
+	/* The host is released before the command finishes */
+	TEST_ASSERT(raw.responses == 1);
+	TEST_ASSERT(h->result == EC_RES_IN_PROGRESS);
+	TEST_ASSERT(comms_status() == EC_COMMS_STATUS_PROCESSING);
+
+	msleep(200);
+	TEST_ASSERT(comms_status() == 0);
+
+	/* Fetch the full response */
+	send_raw(EC_CMD_RESEND_RESPONSE, NULL, 0);
+	msleep(10);
+	TEST_ASSERT(raw.responses == 1);
+	TEST_ASSERT(h->result == EC_RES_SUCCESS);
+	TEST_ASSERT(h->data_len == 2 * sizeof(uint32_t));
+	TEST_ASSERT(data[0] == 0x12345678 && data[1] == ~0x12345678);
+	TEST_ASSERT(checksum(raw.resp, sizeof(*h) + h->data_len) == 0);
+
+	/* Only once */
+	send_raw(EC_CMD_RESEND_RESPONSE, NULL, 0);
+	msleep(10);
+	TEST_ASSERT(h->result == EC_RES_UNAVAILABLE);
+
+	/* Commands not received from the host just run to completion */
+	TEST_ASSERT(test_send_host_command(TEST_CMD_SLOW, 0, &p, sizeof(p),
+					   raw.resp, sizeof(raw.resp)) ==
+		    EC_RES_SUCCESS);
+	TEST_ASSERT(((uint32_t *)raw.resp)[0] == 0x12345678);
+
+	return EC_SUCCESS;
+}
+
+void run_test(void)
+{
+	test_reset();
+
+	/* Let the host command task initialize */
+	msleep(10);
+
+	RUN_TEST(test_queue_order);
+	RUN_TEST(test_queue_full);
+	RUN_TEST(test_duplicate);
+	RUN_TEST(test_batch);
+	RUN_TEST(test_bad_checksum);
+	RUN_TEST(test_checksum);
+	RUN_TEST(test_stats);
+	RUN_TEST(test_async);
+	RUN_TEST(test_lookup);
+
+	test_print_result();
+}
@@ -0,0 +1,144 @@
+/* Copyright (c) 2013 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Test SHA-256 against known answers and measure its throughput.  Built
+ * as both sha256 and sha256_unroll, to compare the two implementations.
+ */
+
+#include <time.h>
+
+#include "common.h"
+#include "console.h"
+#include "sha256.h"
+#include "test_util.h"
+#include "util.h"
+
+#ifdef CONFIG_SHA256_UNROLL
+#define IMPL_NAME "unrolled"
+#else
+#define IMPL_NAME "loop"
+#endif
+
+/* Benchmark hashes this much data, a buffer at a time */
+#define BENCH_BUF_SIZE 4096
+#define BENCH_TOTAL (4 * 1024 * 1024)
+
+static struct sha256_ctx ctx;
+static uint8_t buf[BENCH_BUF_SIZE + 4] __aligned(4);
+
+static int check_hash(const char *msg, const uint8_t *expected)
+{
+	const uint8_t *hash;
+
+	SHA256_init(&ctx);
+	SHA256_update(&ctx, (const uint8_t *)msg, strlen(msg));
+	hash = SHA256_final(&ctx);
+	TEST_ASSERT_ARRAY_EQ(hash, expected, SHA256_DIGEST_SIZE);
+
+	return EC_SUCCESS;
+}
+
+static int test_known_answers(void)
+{
+	static const uint8_t empty[] = {
+		0xe3, 0xb0, 0xc4, 0x42, 0x98, 0xfc, 0x1c, 0x14,
+		0x9a, 0xfb, 0xf4, 0xc8, 0x99, 0x6f, 0xb9, 0x24,
+		0x27, 0xae, 0x41, 0xe4, 0x64, 0x9b, 0x93, 0x4c,
+		0xa4, 0x95, 0x99, 0x1b, 0x78, 0x52, 0xb8, 0x55};
+	static const uint8_t abc[] = {
+		0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea,
+		0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+		0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c,
+		0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad};
+	static const uint8_t two_blocks[] = {
+		0x24, 0x8d, 0x6a, 0x61, 0xd2, 0x06, 0x38, 0xb8,
+		0xe5, 0xc0, 0x26, 0x93, 0x0c, 0x3e, 0x60, 0x39,
+		0xa3, 0x3c, 0xe4, 0x59, 0x64, 0xff, 0x21, 0x67,
+		0xf6, 0xec, 0xed, 0xd4, 0x19, 0xdb, 0x06, 0xc1};
+	static const uint8_t million_a[] = {
+		0xcd, 0xc7, 0x6e, 0x5c, 0x99, 0x14, 0xfb, 0x92,
+		0x81, 0xa1, 0xc7, 0xe2, 0x84, 0xd7, 0x3e, 0x67,
+		0xf1, 0x80, 0x9a, 0x48, 0xa4, 0x97, 0x20, 0x0e,
+		0x04, 0x6d, 0x39, 0xcc, 0xc7, 0x11, 0x2c, 0xd0};
+	const uint8_t *hash;
+	int i;
+
+	TEST_ASSERT(check_hash("", empty) == EC_SUCCESS);
+	TEST_ASSERT(check_hash("abc", abc) == EC_SUCCESS);
+	TEST_ASSERT(check_hash("abcdbcdecdefdefgefghfghighijhijkijkljklmklmn"
+			       "lmnomnopnopq", two_blocks) == EC_SUCCESS);
+
+	memset(buf, 'a', 1000);
+	SHA256_init(&ctx);
+	for (i = 0; i < 1000; i++)
+		SHA256_update(&ctx, buf, 1000);
+	hash = SHA256_final(&ctx);
+	TEST_ASSERT_ARRAY_EQ(hash, million_a, SHA256_DIGEST_SIZE);
+
+	return EC_SUCCESS;
+}
+
+static int test_unaligned(void)
+{
+	uint8_t aligned_hash[SHA256_DIGEST_SIZE];
+	const uint8_t *hash;
+	int i, pos, len;
+
+	for (i = 0; i < sizeof(buf); i++)
+		buf[i] = i * 7 + (i >> 8);
+
+	SHA256_init(&ctx);
+	SHA256_update(&ctx, buf, BENCH_BUF_SIZE);
+	memcpy(aligned_hash, SHA256_final(&ctx), sizeof(aligned_hash));
+
+	/* Same data from an odd address, in odd-sized pieces */
+	memmove(buf + 1, buf, BENCH_BUF_SIZE);
+	SHA256_init(&ctx);
+	for (pos = 0; pos < BENCH_BUF_SIZE; pos += len) {
+		len = MIN(BENCH_BUF_SIZE - pos, 1 + pos % 131);
+		SHA256_update(&ctx, buf + 1 + pos, len);
+	}
+	hash = SHA256_final(&ctx);
+	TEST_ASSERT_ARRAY_EQ(hash, aligned_hash, SHA256_DIGEST_SIZE);
+
+	return EC_SUCCESS;
+}
+
+/* Return nanoseconds per KB to hash data from <data> */
+static int bench(const uint8_t *data)
+{
+	struct timespec start, end;
+	uint64_t ns;
+	int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	SHA256_init(&ctx);
+	for (i = 0; i < BENCH_TOTAL / BENCH_BUF_SIZE; i++)
+		SHA256_update(&ctx, data, BENCH_BUF_SIZE);
+	SHA256_final(&ctx);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	ns = (end.tv_sec - start.tv_sec) * 1000000000ULL +
+	     end.tv_nsec - start.tv_nsec;
+	return ns / (BENCH_TOTAL / 1024);
+}
+
+static int test_benchmark(void)
+{
+	ccprintf("SHA-256 (%s): %d ns/KB aligned, %d ns/KB unaligned\n",
+		 IMPL_NAME, bench(buf), bench(buf + 1));
+
+	return EC_SUCCESS;
+}
+
+void run_test(void)
+{
+	test_reset();
+
+	RUN_TEST(test_known_answers);
+	RUN_TEST(test_unaligned);
+	RUN_TEST(test_benchmark);
+
+	test_print_result();
+}
@@ -8,6 +8,9 @@
 #ifndef __CROS_EC_TEST_CONFIG_H
 #define __CROS_EC_TEST_CONFIG_H
 
+/* Emulator tests run on virtual time */
+#define CONFIG_EMU_VIRTUAL_TIME
+
 #ifdef TEST_kb_8042
 #undef CONFIG_KEYBOARD_PROTOCOL_MKBP
 #define CONFIG_KEYBOARD_PROTOCOL_8042
@@ -30,4 +33,34 @@
 #define CONFIG_CHARGER_INPUT_CURRENT 4032
 #endif
 
+#ifdef TEST_console_deferred
+/* Small enough that a full buffer's output fits in the UART buffer */
+#define CONFIG_CONSOLE_DEFERRED 32
+#endif
+
+#ifdef TEST_console_rate
+#define CONFIG_CONSOLE_RATE_LIMIT 1000
+#endif
+
+#ifdef TEST_flash
+#define CONFIG_FLASH_STATS
+#endif
+
+#ifdef TEST_flash_wear
+#define CONFIG_FLASH_STATS
+#endif
+
+#ifdef TEST_flash_write_combine
+#define CONFIG_FLASH_WRITE_COMBINE
+#endif
+
+#ifdef TEST_host_command
+#define CONFIG_HOST_COMMAND_STATS
+#define CONFIG_HOST_COMMAND_STATUS
+#endif
+
+#ifdef TEST_sha256_unroll
+#define CONFIG_SHA256_UNROLL
+#endif
+
 #endif  /* __CROS_EC_TEST_CONFIG_H */
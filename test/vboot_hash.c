@@ -0,0 +1,209 @@
+/* Copyright (c) 2013 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Test vboot hash computation and checkpointing.
+ */
+
+#include "common.h"
+#include "console.h"
+#include "ec_commands.h"
+#include "flash.h"
+#include "host_command.h"
+#include "sha256.h"
+#include "task.h"
+#include "test_util.h"
+#include "timer.h"
+#include "util.h"
+
+#define HASH_OFFSET CONFIG_FW_RW_OFF
+#define HASH_SIZE 0x8000
+
+static struct sha256_ctx ref_ctx;
+
+/* Compute the expected digest directly from flash */
+static const uint8_t *expected_hash(int offset, int size,
+				    const uint8_t *nonce, int nonce_size)
+{
+	SHA256_init(&ref_ctx);
+	if (nonce_size)
+		SHA256_update(&ref_ctx, nonce, nonce_size);
+	SHA256_update(&ref_ctx,
+		      (const uint8_t *)(CONFIG_FLASH_BASE + offset), size);
+	return SHA256_final(&ref_ctx);
+}
+
+/* Wait for the hash in progress to finish */
+static int wait_hash(struct ec_response_vboot_hash_1 *r)
+{
+	struct ec_params_vboot_hash p;
+
+	memset(&p, 0, sizeof(p));
+	p.cmd = EC_VBOOT_HASH_GET;
+	do {
+		usleep(100);
+		if (test_send_host_command(EC_CMD_VBOOT_HASH, 1, &p, sizeof(p),
+					   r, sizeof(*r)) != EC_RES_SUCCESS)
+			return EC_ERROR_UNKNOWN;
+	} while (r->status == EC_VBOOT_HASH_STATUS_BUSY);
+
+	return EC_SUCCESS;
+}
+
+/* Start a hash and wait for it to finish */
+static int hash_and_wait(int offset, int size, const uint8_t *nonce,
+			 int nonce_size, struct ec_response_vboot_hash_1 *r)
+{
+	struct ec_params_vboot_hash p;
+
+	memset(&p, 0, sizeof(p));
+	p.cmd = EC_VBOOT_HASH_START;
+	p.hash_type = EC_VBOOT_HASH_TYPE_SHA256;
+	p.offset = offset;
+	p.size = size;
+	p.nonce_size = nonce_size;
+	memcpy(p.nonce_data, nonce, nonce_size);
+
+	if (test_send_host_command(EC_CMD_VBOOT_HASH, 1, &p, sizeof(p),
+				   r, sizeof(*r)) != EC_RES_SUCCESS)
+		return EC_ERROR_UNKNOWN;
+
+	return wait_hash(r);
+}
+
+static int test_full(void)
+{
+	struct ec_response_vboot_hash_1 r;
+
+	TEST_ASSERT(hash_and_wait(HASH_OFFSET, HASH_SIZE, NULL, 0, &r) == EC_SUCCESS);
+	TEST_ASSERT(r.status == EC_VBOOT_HASH_STATUS_DONE);
+	TEST_ASSERT(r.offset == HASH_OFFSET && r.size == HASH_SIZE);
+	TEST_ASSERT(r.hashed_size == HASH_SIZE);
+	TEST_ASSERT_ARRAY_EQ(r.hash_digest,
+			     expected_hash(HASH_OFFSET, HASH_SIZE, NULL, 0),
+			     SHA256_DIGEST_SIZE);
+
+	return EC_SUCCESS;
+}
+
+static int test_rehash_after_write(void)
+{
+	struct ec_response_vboot_hash_1 r;
+	const char data[16] = "vboot_hash test";
+
+	/* Start from scratch with a different region */
+	TEST_ASSERT(hash_and_wait(HASH_OFFSET, HASH_SIZE / 2, NULL, 0, &r) ==
+		    EC_SUCCESS);
+	TEST_ASSERT(hash_and_wait(HASH_OFFSET, HASH_SIZE, NULL, 0, &r) ==
+		    EC_SUCCESS);
+	TEST_ASSERT(r.hashed_size == HASH_SIZE);
+
+	/* Modify the last erase block; only it should be rehashed */
+	TEST_ASSERT(flash_erase(HASH_OFFSET + HASH_SIZE -
+				CONFIG_FLASH_ERASE_SIZE,
+				CONFIG_FLASH_ERASE_SIZE) == EC_SUCCESS);
+	TEST_ASSERT(flash_write(HASH_OFFSET + HASH_SIZE - sizeof(data),
+				sizeof(data), data) == EC_SUCCESS);
+
+	TEST_ASSERT(hash_and_wait(HASH_OFFSET, HASH_SIZE, NULL, 0, &r) ==
+		    EC_SUCCESS);
+	TEST_ASSERT(r.status == EC_VBOOT_HASH_STATUS_DONE);
+	TEST_ASSERT(r.hashed_size == CONFIG_FLASH_ERASE_SIZE);
+	TEST_ASSERT_ARRAY_EQ(r.hash_digest,
+			     expected_hash(HASH_OFFSET, HASH_SIZE, NULL, 0),
+			     SHA256_DIGEST_SIZE);
+
+	/* Modify the first erase block; everything is rehashed */
+	TEST_ASSERT(flash_erase(HASH_OFFSET, CONFIG_FLASH_ERASE_SIZE) ==
+		    EC_SUCCESS);
+	TEST_ASSERT(hash_and_wait(HASH_OFFSET, HASH_SIZE, NULL, 0, &r) == EC_SUCCESS);
+	TEST_ASSERT(r.status == EC_VBOOT_HASH_STATUS_DONE);
+	TEST_ASSERT(r.hashed_size == HASH_SIZE);
+	TEST_ASSERT_ARRAY_EQ(r.hash_digest,
+			     expected_hash(HASH_OFFSET, HASH_SIZE, NULL, 0),
+			     SHA256_DIGEST_SIZE);
+
+	return EC_SUCCESS;
+}
+
+static int busy_runs;
+
+/* Lower priority than the hash task, so only runs when it yields */
+void busy_task(void)
+{
+	while (1) {
+		task_wait_event(-1);
+		busy_runs++;
+	}
+}
+
+static int test_adaptive_chunks(void)
+{
+	struct ec_response_vboot_hash_1 r;
+	const char data[16] = "adaptive chunks";
+
+	/*
+	 * With nothing else to run, the hash doesn't stop to sleep between
+	 * chunks (which takes 100 us each time).
+	 */
+	TEST_ASSERT(flash_write(HASH_OFFSET, sizeof(data), data) ==
+		    EC_SUCCESS);
+	TEST_ASSERT(hash_and_wait(HASH_OFFSET, HASH_SIZE, NULL, 0, &r) ==
+		    EC_SUCCESS);
+	TEST_ASSERT(r.hashed_size == HASH_SIZE);
+	TEST_ASSERT(r.hash_time_us < 100);
+
+	/* Hash backs off to let a waiting task run */
+	TEST_ASSERT(flash_write(HASH_OFFSET, sizeof(data), data) ==
+		    EC_SUCCESS);
+	busy_runs = 0;
+	task_wake(TASK_ID_BUSY);
+	TEST_ASSERT(hash_and_wait(HASH_OFFSET, HASH_SIZE, NULL, 0, &r) ==
+		    EC_SUCCESS);
+	TEST_ASSERT(r.hashed_size == HASH_SIZE);
+	TEST_ASSERT(busy_runs == 1);
+	TEST_ASSERT(r.hash_time_us >= 100);
+
+	return EC_SUCCESS;
+}
+
+static int test_nonce(void)
+{
+	struct ec_response_vboot_hash_1 r;
+	const uint8_t nonce[] = {0x12, 0x34, 0x56};
+
+	/* A nonce changes the whole hash, so checkpoints aren't used */
+	TEST_ASSERT(hash_and_wait(HASH_OFFSET, HASH_SIZE, nonce,
+				  sizeof(nonce), &r) == EC_SUCCESS);
+	TEST_ASSERT(r.status == EC_VBOOT_HASH_STATUS_DONE);
+	TEST_ASSERT_ARRAY_EQ(r.hash_digest,
+			     expected_hash(HASH_OFFSET, HASH_SIZE,
+					   nonce, sizeof(nonce)),
+			     SHA256_DIGEST_SIZE);
+
+	/* But they are kept for the next hash without one */
+	TEST_ASSERT(hash_and_wait(HASH_OFFSET, HASH_SIZE, NULL, 0, &r) == EC_SUCCESS);
+	TEST_ASSERT(r.status == EC_VBOOT_HASH_STATUS_DONE);
+	TEST_ASSERT_ARRAY_EQ(r.hash_digest,
+			     expected_hash(HASH_OFFSET, HASH_SIZE, NULL, 0),
+			     SHA256_DIGEST_SIZE);
+
+	return EC_SUCCESS;
+}
+
+void run_test(void)
+{
+	struct ec_response_vboot_hash_1 r;
+
+	test_reset();
+
+	/* Wait for the boot-time hash of RW to finish */
+	wait_hash(&r);
+
+	RUN_TEST(test_full);
+	RUN_TEST(test_rehash_after_write);
+	RUN_TEST(test_adaptive_chunks);
+	RUN_TEST(test_nonce);
+
+	test_print_result();
+}
@@ -16,6 +16,7 @@
 #include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <unistd.h>
 
 #include "comm-host.h"
 
@@ -26,6 +27,10 @@
 #define I2C_MAX_ADAPTER  32
 #define I2C_NODE "/dev/i2c-%d"
 
+/* How long to wait for a command which returned EC_RES_IN_PROGRESS */
+#define IN_PROGRESS_POLL_US 10000	/* 10 ms */
+#define IN_PROGRESS_TIMEOUT_US 5000000	/* 5 s */
+
 #ifdef DEBUG
 #define debug(format, arg...) printf(format, ##arg)
 #else
@@ -41,9 +46,9 @@ static int i2c_fd = -1;
  * Returns >= 0 for success, or negative if error.
  *
  */
-static int ec_command_i2c(int command, int version,
-			  const void *outdata, int outsize,
-			  void *indata, int insize)
+static int ec_command_i2c_once(int command, int version,
+			       const void *outdata, int outsize,
+			       void *indata, int insize)
 {
 	struct i2c_rdwr_ioctl_data data;
 	int ret = -1;
@@ -126,7 +131,6 @@ static int ec_command_i2c(int command, int version,
 
 	/* check response error code */
 	ret = resp_buf[0];
-	/* TODO: handle EC_RES_IN_PROGRESS case. */
 
 	resp_len = resp_buf[1];
 	if (resp_len > insize) {
@@ -169,6 +173,41 @@ done:
 	return ret;
 }
 
+/*
+ * Sends a command to the EC.  If the EC answers that the command is still in
+ * progress, waits for it to finish and fetches the final response.
+ */
+static int ec_command_i2c(int command, int version,
+			  const void *outdata, int outsize,
+			  void *indata, int insize)
+{
+	struct ec_response_get_comms_status status;
+	int ret;
+	int waited;
+
+	ret = ec_command_i2c_once(command, version, outdata, outsize,
+				  indata, insize);
+	if (ret != -EC_RES_IN_PROGRESS)
+		return ret;
+
+	for (waited = 0; waited < IN_PROGRESS_TIMEOUT_US;
+	     waited += IN_PROGRESS_POLL_US) {
+		usleep(IN_PROGRESS_POLL_US);
+
+		ret = ec_command_i2c_once(EC_CMD_GET_COMMS_STATUS, 0, NULL, 0,
+					  &status, sizeof(status));
+		if (ret < 0)
+			return ret;
+
+		if (!(status.flags & EC_COMMS_STATUS_PROCESSING))
+			return ec_command_i2c_once(EC_CMD_RESEND_RESPONSE, 0,
+						   NULL, 0, indata, insize);
+	}
+
+	fprintf(stderr, "Timeout waiting for EC command 0x%02x\n", command);
+	return -EC_RES_TIMEOUT;
+}
+
 int comm_init_i2c(void)
 {
 	char *file_path;
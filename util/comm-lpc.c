@@ -10,6 +10,7 @@
 #include <unistd.h>
 
 #include "comm-host.h"
+#include "ec_checksum.h"
 
 #define INITIAL_UDELAY 5     /* 5 us */
 #define MAXIMUM_UDELAY 10000 /* 10 ms */
@@ -134,7 +135,7 @@ static int ec_command_lpc_3(int command, int version,
 	struct ec_host_response rs;
 	const uint8_t *d;
 	uint8_t *dout;
-	int csum = 0;
+	uint8_t csum;
 	int i;
 
 	/* Fail if output size is too big */
@@ -150,19 +151,15 @@ static int ec_command_lpc_3(int command, int version,
 	rq.reserved = 0;
 	rq.data_len = outsize;
 
-	/* Copy data and start checksum */
-	for (i = 0, d = (const uint8_t *)outdata; i < outsize; i++, d++) {
-		outb(*d, EC_LPC_ADDR_HOST_PACKET + sizeof(rq) + i);
-		csum += *d;
-	}
-
-	/* Finish checksum */
-	for (i = 0, d = (const uint8_t *)&rq; i < sizeof(rq); i++, d++)
-		csum += *d;
-
 	/* Write checksum field so the entire packet sums to 0 */
+	csum = ec_checksum_add(0, &rq, sizeof(rq));
+	csum = ec_checksum_add(csum, outdata, outsize);
 	rq.checksum = (uint8_t)(-csum);
 
+	/* Copy data */
+	for (i = 0, d = (const uint8_t *)outdata; i < outsize; i++, d++)
+		outb(*d, EC_LPC_ADDR_HOST_PACKET + sizeof(rq) + i);
+
 	/* Copy header */
 	for (i = 0, d = (const uint8_t *)&rq; i < sizeof(rq); i++, d++)
 		outb(*d, EC_LPC_ADDR_HOST_PACKET + i);
@@ -182,12 +179,9 @@ static int ec_command_lpc_3(int command, int version,
 		return -i;
 	}
 
-	/* Read back response header and start checksum */
-	csum = 0;
-	for (i = 0, dout = (uint8_t *)&rs; i < sizeof(rs); i++, dout++) {
+	/* Read back response header */
+	for (i = 0, dout = (uint8_t *)&rs; i < sizeof(rs); i++, dout++)
 		*dout = inb(EC_LPC_ADDR_HOST_PACKET + i);
-		csum += *dout;
-	}
 
 	if (rs.struct_version != EC_HOST_RESPONSE_VERSION) {
 		fprintf(stderr, "EC response version mismatch\n");
@@ -204,14 +198,14 @@ static int ec_command_lpc_3(int command, int version,
 		return -EC_RES_RESPONSE_TOO_BIG;
 	}
 
-	/* Read back data and update checksum */
-	for (i = 0, dout = (uint8_t *)indata; i < rs.data_len; i++, dout++) {
+	/* Read back data */
+	for (i = 0, dout = (uint8_t *)indata; i < rs.data_len; i++, dout++)
 		*dout = inb(EC_LPC_ADDR_HOST_PACKET + sizeof(rs) + i);
-		csum += *dout;
-	}
 
 	/* Verify checksum */
-	if ((uint8_t)csum) {
+	csum = ec_checksum_add(0, &rs, sizeof(rs));
+	csum = ec_checksum_add(csum, indata, rs.data_len);
+	if (csum) {
 		fprintf(stderr, "EC response has invalid checksum\n");
 		return -EC_RES_INVALID_CHECKSUM;
 	}
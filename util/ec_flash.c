@@ -10,25 +10,94 @@
 #include <string.h>
 
 #include "comm-host.h"
+#include "ec_crc32.h"
 #include "misc_util.h"
 
+/* Block states used by ec_flash_update() */
+#define BLOCK_ERASE (1 << 0)  /* Block needs erasing */
+#define BLOCK_WRITE (1 << 1)  /* Block needs writing */
+
 int ec_flash_read(uint8_t *buf, int offset, int size)
 {
 	struct ec_params_flash_read p;
 	int rv;
 	int i;
 
-	/* Read data in chunks */
+	/* Read data in chunks, directly into the destination */
 	for (i = 0; i < size; i += ec_max_insize) {
 		p.offset = offset + i;
 		p.size = MIN(size - i, ec_max_insize);
 		rv = ec_command(EC_CMD_FLASH_READ, 0,
-				&p, sizeof(p), ec_inbuf, p.size);
+				&p, sizeof(p), buf + i, p.size);
 		if (rv < 0) {
 			fprintf(stderr, "Read error at offset %d\n", i);
 			return rv;
 		}
-		memcpy(buf + i, ec_inbuf, p.size);
+	}
+
+	return 0;
+}
+
+int ec_flash_read_multi(uint8_t *buf, const struct ec_params_flash_read *region,
+			int count)
+{
+	struct ec_params_flash_read_multi *p =
+		(struct ec_params_flash_read_multi *)ec_outbuf;
+	int max_count = MIN(EC_FLASH_READ_MULTI_MAX,
+			    (int)((ec_max_outsize - sizeof(*p)) /
+				  sizeof(p->region[0])));
+	uint32_t done = 0;  /* Bytes of current region already read */
+	int pos = 0;
+	int rsize;
+	int rv;
+	int i;
+
+	if (!ec_cmd_version_supported(EC_CMD_FLASH_READ,
+				      EC_VER_FLASH_READ_MULTI)) {
+		/* Fall back to reading one region at a time */
+		for (i = 0; i < count; pos += region[i++].size) {
+			rv = ec_flash_read(buf + pos, region[i].offset,
+					   region[i].size);
+			if (rv < 0)
+				return rv;
+		}
+		return 0;
+	}
+
+	/*
+	 * Pack as many regions (or pieces of regions) as fit into each
+	 * response.  The responses land back to back in the destination
+	 * buffer, so there is nothing to copy afterwards.
+	 */
+	i = 0;
+	while (i < count) {
+		p->count = 0;
+		rsize = 0;
+		while (i < count && p->count < max_count &&
+		       rsize < ec_max_insize) {
+			struct ec_params_flash_read *r =
+				p->region + p->count++;
+
+			r->offset = region[i].offset + done;
+			r->size = MIN(region[i].size - done,
+				      (uint32_t)(ec_max_insize - rsize));
+			rsize += r->size;
+			done += r->size;
+			if (done == region[i].size) {
+				done = 0;
+				i++;
+			}
+		}
+
+		rv = ec_command(EC_CMD_FLASH_READ, EC_VER_FLASH_READ_MULTI,
+				p, sizeof(*p) + p->count * sizeof(p->region[0]),
+				buf + pos, rsize);
+		if (rv < 0) {
+			fprintf(stderr, "Read error at offset 0x%x\n",
+				p->region[0].offset);
+			return rv;
+		}
+		pos += rsize;
 	}
 
 	return 0;
@@ -125,3 +194,197 @@ int ec_flash_erase(int offset, int size)
 
 	return ec_command(EC_CMD_FLASH_ERASE, 0, &p, sizeof(p), NULL, 0);
 }
+
+/**
+ * Get the CRC-32 of each of <count> blocks of <block_size> bytes at <offset>.
+ */
+static int ec_flash_block_crc(uint32_t *crc, int offset, int block_size,
+			      int count)
+{
+	struct ec_params_flash_block_crc p;
+	int step = ec_max_insize / sizeof(*crc);
+	int rv;
+	int i;
+
+	p.block_size = block_size;
+	for (i = 0; i < count; i += step) {
+		p.offset = offset + i * block_size;
+		p.count = MIN(count - i, step);
+		rv = ec_command(EC_CMD_FLASH_BLOCK_CRC, 0, &p, sizeof(p),
+				crc + i, p.count * sizeof(*crc));
+		if (rv < 0) {
+			fprintf(stderr, "Block CRC error at offset %d\n",
+				p.offset);
+			return rv;
+		}
+	}
+
+	return 0;
+}
+
+/* Get which of a run of erase blocks are erased, as a bitmap */
+static int ec_flash_erased_map(uint8_t *map, int offset, int block_size,
+			       int count)
+{
+	struct ec_params_flash_erased_map p;
+	int step = ec_max_insize * 8;
+	int rv;
+	int i;
+
+	for (i = 0; i < count; i += step) {
+		p.offset = offset + i * block_size;
+		p.count = MIN(count - i, step);
+		rv = ec_command(EC_CMD_FLASH_ERASED_MAP, 0, &p, sizeof(p),
+				map + i / 8, (p.count + 7) / 8);
+		if (rv < 0) {
+			fprintf(stderr, "Erased map error at offset %d\n",
+				p.offset);
+			return rv;
+		}
+	}
+
+	return 0;
+}
+
+int ec_flash_update(const uint8_t *buf, int offset, int size)
+{
+	struct ec_response_flash_info_1 info;
+	int info_size = sizeof(struct ec_response_flash_info);
+	int info_ver = 0;
+	uint8_t erased_value = 0xff;
+	uint8_t *image;
+	uint8_t *erased = NULL;
+	uint32_t *crc;
+	int block, count, run;
+	int changed = 0;
+	int rv;
+	int i;
+
+	if (!ec_cmd_version_supported(EC_CMD_FLASH_BLOCK_CRC, 0)) {
+		/* Rewrite the whole region the old way */
+		rv = ec_flash_erase(offset, size);
+		if (rv < 0)
+			return rv;
+		rv = ec_flash_write(buf, offset, size);
+		if (rv < 0)
+			return rv;
+		return ec_flash_verify(buf, offset, size);
+	}
+
+	/* Version 1 tells us what value erased flash holds */
+	memset(&info, 0, sizeof(info));
+	if (ec_cmd_version_supported(EC_CMD_FLASH_INFO, 1)) {
+		info_ver = 1;
+		info_size = sizeof(info);
+	}
+	rv = ec_command(EC_CMD_FLASH_INFO, info_ver, NULL, 0, &info,
+			info_size);
+	if (rv < 0)
+		return rv;
+	if (info.flags & EC_FLASH_INFO_ERASE_TO_0)
+		erased_value = 0;
+
+	block = info.erase_block_size;
+	if (offset % block) {
+		fprintf(stderr, "Offset 0x%x not a multiple of erase size "
+			"0x%x\n", offset, block);
+		return -1;
+	}
+
+	/*
+	 * Pad the image to whole erase blocks with the erased value, which
+	 * is what erasing and writing the region would leave in flash.
+	 */
+	count = (size + block - 1) / block;
+	image = (uint8_t *)malloc(count * block);
+	crc = (uint32_t *)malloc(count * sizeof(*crc));
+	if (!image || !crc) {
+		fprintf(stderr, "Unable to allocate buffer.\n");
+		rv = -1;
+		goto done;
+	}
+	memcpy(image, buf, size);
+	memset(image + size, erased_value, count * block - size);
+
+	rv = ec_flash_block_crc(crc, offset, block, count);
+	if (rv < 0)
+		goto done;
+
+	/* Find out which blocks are already blank, if the EC can tell us */
+	erased = (uint8_t *)calloc((count + 7) / 8, 1);
+	if (!erased) {
+		fprintf(stderr, "Unable to allocate buffer.\n");
+		rv = -1;
+		goto done;
+	}
+	if (ec_cmd_version_supported(EC_CMD_FLASH_ERASED_MAP, 0)) {
+		rv = ec_flash_erased_map(erased, offset, block, count);
+		if (rv < 0)
+			goto done;
+	}
+
+	/*
+	 * Replace each CRC with whether the block differs from the image:
+	 * BLOCK_ERASE if it needs erasing before it's written, or BLOCK_WRITE
+	 * if it's already blank.
+	 */
+	for (i = 0; i < count; i++) {
+		if (crc[i] == ec_crc32_add(0, image + i * block, block))
+			crc[i] = 0;
+		else if (erased[i / 8] & (1 << (i % 8)))
+			crc[i] = BLOCK_WRITE;
+		else
+			crc[i] = BLOCK_ERASE | BLOCK_WRITE;
+	}
+
+	/* Erase each run of blocks which need it */
+	for (i = 0; i < count; i += run) {
+		for (run = 0; i + run < count && (crc[i + run] & BLOCK_ERASE);
+		     run++)
+			;
+		if (!run) {
+			run = 1;
+			continue;
+		}
+
+		rv = ec_flash_erase(offset + i * block, run * block);
+		if (rv < 0)
+			goto done;
+	}
+
+	/* Write each run of blocks which differ */
+	for (i = 0; i < count; i += run) {
+		for (run = 0; i + run < count && crc[i + run]; run++)
+			;
+		if (!run) {
+			run = 1;
+			continue;
+		}
+
+		rv = ec_flash_write(image + i * block, offset + i * block,
+				    run * block);
+		if (rv < 0)
+			goto done;
+		changed += run;
+	}
+	printf("Updated %d of %d blocks.\n", changed, count);
+
+	/* Verify by CRC instead of reading everything back */
+	rv = ec_flash_block_crc(crc, offset, block, count);
+	if (rv < 0)
+		goto done;
+	for (i = 0; i < count; i++) {
+		if (crc[i] != ec_crc32_add(0, image + i * block, block)) {
+			fprintf(stderr, "Mismatch in block at offset 0x%x\n",
+				offset + i * block);
+			rv = -1;
+			goto done;
+		}
+	}
+
+done:
+	free(image);
+	free(erased);
+	free(crc);
+	return rv;
+}
@@ -17,6 +17,21 @@
  */
 int ec_flash_read(uint8_t *buf, int offset, int size);
 
+/**
+ * Read several regions of EC flash memory
+ *
+ * Uses multi-region reads if the EC supports them, so scattered regions take
+ * as few commands as possible.
+ *
+ * @param buf		Destination buffer; region data is stored back to back
+ * @param region	Regions to read
+ * @param count		Number of regions
+ *
+ * @return 0 if success, negative if error.
+ */
+int ec_flash_read_multi(uint8_t *buf, const struct ec_params_flash_read *region,
+			int count);
+
 /**
  * Verify EC flash memory
  *
@@ -39,6 +54,23 @@ int ec_flash_verify(const uint8_t *buf, int offset, int size);
  */
 int ec_flash_write(const uint8_t *buf, int offset, int size);
 
+/**
+ * Update EC flash memory to match an image
+ *
+ * Only erases and writes the erase blocks whose CRC differs from the image,
+ * then verifies the region by CRC instead of reading it back.  Falls back to
+ * erasing, writing and verifying the whole region if the EC doesn't support
+ * block CRCs.
+ *
+ * @param buf		Source buffer
+ * @param offset	Offset in EC flash to write; must be a multiple of the
+ *			erase block size
+ * @param size		Number of bytes to write
+ *
+ * @return 0 if success, negative if error.
+ */
+int ec_flash_update(const uint8_t *buf, int offset, int size);
+
 /**
  * Erase EC flash memory
  *
@@ -37,6 +37,8 @@ const char help_str[] =
 	"      Prints battery info\n"
 	"  batterycutoff\n"
 	"      Cut off battery output power\n"
+	"  batch <cmd>[.<ver>][:<hexparams>] [...]\n"
+	"      Run several host commands in one request\n"
 	"  chargecurrentlimit\n"
 	"      Set the maximum battery charging current\n"
 	"  chargedump\n"
@@ -45,10 +47,14 @@ const char help_str[] =
 	"      Force the battery to stop charging or discharge\n"
 	"  chipinfo\n"
 	"      Prints chip info\n"
+	"  chstats\n"
+	"      Prints EC console output statistics for each channel\n"
 	"  cmdversions <cmd>\n"
 	"      Prints supported version mask for a command number\n"
-	"  console\n"
-	"      Prints the last output to the EC debug console\n"
+	"  console [seq]\n"
+	"      Prints the last output to the EC debug console.  With seq, prints\n"
+	"      output from that sequence number on.  The sequence number for\n"
+	"      the next read is printed to stderr.\n"
 	"  echash [CMDS]\n"
 	"      Various EC hash commands\n"
 	"  eventclear <mask>\n"
@@ -79,14 +85,18 @@ const char help_str[] =
 	"      Prints information on the EC flash\n"
 	"  flashprotect [now] [enable | disable]\n"
 	"      Prints or sets EC flash protection state\n"
-	"  flashread <offset> <size> <outfile>\n"
-	"      Reads from EC flash to a file\n"
+	"  flashread <offset> <size> [<offset> <size> ...] <outfile>\n"
+	"      Reads one or more regions of EC flash to a file\n"
+	"  flashupdate <offset> <infile>\n"
+	"      Rewrites only the EC flash blocks which differ from a file\n"
 	"  flashwrite <offset> <infile>\n"
 	"      Writes to EC flash from a file\n"
 	"  gpioget <GPIO name>\n"
 	"      Get the value of GPIO signal\n"
 	"  gpioset <GPIO name>\n"
 	"      Set the value of GPIO signal\n"
+	"  hcstats [reset]\n"
+	"      Prints host command statistics, then optionally resets them\n"
 	"  hello\n"
 	"      Checks for basic communication with EC\n"
 	"  kbpress\n"
@@ -341,6 +351,173 @@ int cmd_s5(int argc, char *argv[])
 }
 
 
+/**
+ * Parse one batch sub-request of the form <cmd>[.<ver>][:<hexparams>].
+ *
+ * @param arg		Argument to parse
+ * @param req		Sub-request header to fill in; params follow it
+ * @param max_data	Maximum number of param bytes
+ * @return 0 if success, -1 if error.
+ */
+static int parse_batch_cmd(const char *arg, struct ec_params_batch_cmd *req,
+			   int max_data)
+{
+	uint8_t *data = (uint8_t *)(req + 1);
+	char *e;
+	int i;
+
+	req->command = strtol(arg, &e, 0);
+	req->command_version = 0;
+	req->data_len = 0;
+	if (e == arg)
+		return -1;
+
+	if (*e == '.') {
+		arg = e + 1;
+		req->command_version = strtol(arg, &e, 0);
+		if (e == arg)
+			return -1;
+	}
+
+	if (*e == ':') {
+		for (arg = e + 1; *arg; arg += 2) {
+			char byte[3] = {arg[0], arg[1], 0};
+
+			if (req->data_len >= max_data || req->data_len >= 0xff)
+				return -1;
+			data[req->data_len++] = strtol(byte, &e, 16);
+			if (!arg[1] || *e)
+				return -1;
+		}
+	} else if (*e) {
+		return -1;
+	}
+
+	/* Zero the padding */
+	for (i = req->data_len;
+	     i < EC_BATCH_PAD(sizeof(*req) + req->data_len) - sizeof(*req);
+	     i++)
+		data[i] = 0;
+
+	return 0;
+}
+
+int cmd_batch(int argc, char *argv[])
+{
+	struct ec_params_batch *p = ec_outbuf;
+	struct ec_response_batch *r = ec_inbuf;
+	struct ec_params_batch_cmd *req;
+	struct ec_response_batch_cmd *resp;
+	uint8_t *out, *out_end, *in, *in_end;
+	int rv, i, j;
+
+	if (argc < 2 || argc - 1 > 0xff) {
+		fprintf(stderr,
+			"Usage: %s <cmd>[.<ver>][:<hexparams>] [...]\n",
+			argv[0]);
+		return -1;
+	}
+
+	p->count = argc - 1;
+	p->flags = 0;
+	p->reserved = 0;
+	out = (uint8_t *)(p + 1);
+	out_end = (uint8_t *)ec_outbuf + ec_max_outsize;
+
+	for (i = 1; i < argc; i++) {
+		req = (struct ec_params_batch_cmd *)out;
+		if (out + EC_BATCH_PAD(sizeof(*req)) > out_end ||
+		    parse_batch_cmd(argv[i], req, out_end - out - sizeof(*req) -
+				    EC_BATCH_ALIGN)) {
+			fprintf(stderr, "Bad or too long command: %s\n",
+				argv[i]);
+			return -1;
+		}
+		out += EC_BATCH_PAD(sizeof(*req) + req->data_len);
+	}
+
+	rv = ec_command(EC_CMD_BATCH, 0, p, out - (uint8_t *)p,
+			r, ec_max_insize);
+	if (rv < 0)
+		return rv;
+
+	in = (uint8_t *)(r + 1);
+	in_end = (uint8_t *)r + rv;
+	for (i = 0; i < r->count; i++) {
+		resp = (struct ec_response_batch_cmd *)in;
+		if (in + sizeof(*resp) > in_end ||
+		    in + sizeof(*resp) + resp->data_len > in_end) {
+			fprintf(stderr, "Truncated batch response.\n");
+			return -1;
+		}
+
+		printf("%s: result %d", argv[i + 1], resp->result);
+		if (resp->data_len) {
+			printf(", data ");
+			for (j = 0; j < resp->data_len; j++)
+				printf("%02x", ((uint8_t *)(resp + 1))[j]);
+		}
+		printf("\n");
+
+		in += EC_BATCH_PAD(sizeof(*resp) + resp->data_len);
+	}
+
+	return 0;
+}
+
+int cmd_hcstats(int argc, char *argv[])
+{
+	struct ec_params_host_command_stats p;
+	struct ec_response_host_command_stats *r = ec_inbuf;
+	const struct ec_hcstats_entry *e;
+	int reset = 0;
+	int rv, i;
+
+	if (argc > 1) {
+		if (argc > 2 || strcasecmp(argv[1], "reset")) {
+			fprintf(stderr, "Usage: %s [reset]\n", argv[0]);
+			return -1;
+		}
+		reset = 1;
+	}
+
+	printf("Cmd       Calls  Errors  InProg  Min(us)  Max(us)  Avg(us)\n");
+
+	p.offset = 0;
+	p.flags = 0;
+	p.reserved = 0;
+	do {
+		rv = ec_command(EC_CMD_HOST_COMMAND_STATS, 0, &p, sizeof(p),
+				r, ec_max_insize);
+		if (rv < 0)
+			return rv;
+
+		for (i = 0, e = r->entries; i < r->count; i++, e++)
+			printf("0x%02x %10u %7u %7u %8u %8u %8u\n",
+			       e->command, e->calls, e->errors,
+			       e->in_progress, e->min_us, e->max_us,
+			       e->avg_us);
+
+		p.offset += r->count;
+	} while (r->count && p.offset < r->total);
+
+	printf("Execution time histogram:\n");
+	for (i = 0; i < EC_HCSTATS_HISTOGRAM_BUCKETS - 1; i++)
+		printf("  < %6d us %10u\n", 1 << i, r->histogram[i]);
+	printf(" >= %6d us %10u\n", 1 << (i - 1), r->histogram[i]);
+
+	if (reset) {
+		p.offset = r->total;
+		p.flags = EC_HCSTATS_FLAG_RESET;
+		rv = ec_command(EC_CMD_HOST_COMMAND_STATS, 0, &p, sizeof(p),
+				r, ec_max_insize);
+		if (rv < 0)
+			return rv;
+	}
+
+	return 0;
+}
+
 int cmd_cmdversions(int argc, char *argv[])
 {
 	struct ec_params_get_cmd_versions p;
@@ -527,13 +704,19 @@ int cmd_reboot_ec(int argc, char *argv[])
 
 int cmd_flash_info(int argc, char *argv[])
 {
-	struct ec_response_flash_info_1 r;
-	int cmdver = 1;
+	struct ec_response_flash_info_2 r;
+	int cmdver = 2;
 	int rsize = sizeof(r);
 	int rv;
+	int i;
 
 	memset(&r, 0, sizeof(r));
 
+	if (!ec_cmd_version_supported(EC_CMD_FLASH_INFO, cmdver)) {
+		/* Fall back to version 1 command */
+		cmdver = 1;
+		rsize = sizeof(struct ec_response_flash_info_1);
+	}
 	if (!ec_cmd_version_supported(EC_CMD_FLASH_INFO, cmdver)) {
 		/* Fall back to version 0 command */
 		cmdver = 0;
@@ -554,47 +737,76 @@ int cmd_flash_info(int argc, char *argv[])
 		       r.write_ideal_size, r.flags);
 	}
 
+	if (cmdver >= 2) {
+		/* Wear and latency stats available */
+		printf("EraseCountTotal %d\nEraseCountMax %d\n",
+		       r.erase_count_total, r.erase_count_max);
+		printf("WriteMaxUs %d\nEraseMaxUs %d\n",
+		       r.write_max_us, r.erase_max_us);
+		printf("LatencyUs  Writes  Erases\n");
+		for (i = 0; i < EC_FLASH_STATS_BUCKETS; i++)
+			printf("%s%-7d %7d %7d\n",
+			       i < EC_FLASH_STATS_BUCKETS - 1 ? "< " : ">=",
+			       EC_FLASH_STATS_BUCKET_US(
+				       MIN(i, EC_FLASH_STATS_BUCKETS - 2)),
+			       r.write_hist[i], r.erase_hist[i]);
+	}
+
 	return 0;
 }
 
 int cmd_flash_read(int argc, char *argv[])
 {
+	struct ec_params_flash_read region[EC_FLASH_READ_MULTI_MAX];
+	int count, total = 0;
 	int offset, size;
 	int rv;
+	int i;
 	char *e;
 	char *buf;
 
-	if (argc < 4) {
+	count = (argc - 2) / 2;
+	if (argc < 4 || !(argc & 1) || count > EC_FLASH_READ_MULTI_MAX) {
 		fprintf(stderr,
-			"Usage: %s <offset> <size> <filename>\n", argv[0]);
+			"Usage: %s <offset> <size> [<offset> <size> ...] "
+			"<filename>\n", argv[0]);
 		return -1;
 	}
-	offset = strtol(argv[1], &e, 0);
-	if ((e && *e) || offset < 0 || offset > 0x100000) {
-		fprintf(stderr, "Bad offset.\n");
-		return -1;
-	}
-	size = strtol(argv[2], &e, 0);
-	if ((e && *e) || size <= 0 || size > 0x100000) {
-		fprintf(stderr, "Bad size.\n");
-		return -1;
+
+	for (i = 0; i < count; i++) {
+		offset = strtol(argv[1 + 2 * i], &e, 0);
+		if ((e && *e) || offset < 0 || offset > 0x100000) {
+			fprintf(stderr, "Bad offset.\n");
+			return -1;
+		}
+		size = strtol(argv[2 + 2 * i], &e, 0);
+		if ((e && *e) || size <= 0 || size > 0x100000) {
+			fprintf(stderr, "Bad size.\n");
+			return -1;
+		}
+		printf("Reading %d bytes at offset %d...\n", size, offset);
+		region[i].offset = offset;
+		region[i].size = size;
+		total += size;
 	}
-	printf("Reading %d bytes at offset %d...\n", size, offset);
 
-	buf = (char *)malloc(size);
+	buf = (char *)malloc(total);
 	if (!buf) {
 		fprintf(stderr, "Unable to allocate buffer.\n");
 		return -1;
 	}
 
 	/* Read data in chunks */
-	rv = ec_flash_read(buf, offset, size);
+	if (count == 1)
+		rv = ec_flash_read(buf, offset, size);
+	else
+		rv = ec_flash_read_multi(buf, region, count);
 	if (rv < 0) {
 		free(buf);
 		return rv;
 	}
 
-	rv = write_file(argv[3], buf, size);
+	rv = write_file(argv[argc - 1], buf, total);
 	free(buf);
 	if (rv)
 		return rv;
@@ -640,6 +852,41 @@ int cmd_flash_write(int argc, char *argv[])
 	return 0;
 }
 
+int cmd_flash_update(int argc, char *argv[])
+{
+	int offset, size;
+	int rv;
+	char *e;
+	char *buf;
+
+	if (argc < 3) {
+		fprintf(stderr, "Usage: %s <offset> <filename>\n", argv[0]);
+		return -1;
+	}
+
+	offset = strtol(argv[1], &e, 0);
+	if ((e && *e) || offset < 0 || offset > 0x100000) {
+		fprintf(stderr, "Bad offset.\n");
+		return -1;
+	}
+
+	/* Read the input file */
+	buf = read_file(argv[2], &size);
+	if (!buf)
+		return -1;
+
+	printf("Updating %d bytes at offset %d...\n", size, offset);
+	rv = ec_flash_update((const uint8_t *)buf, offset, size);
+
+	free(buf);
+
+	if (rv < 0)
+		return rv;
+
+	printf("done.\n");
+	return 0;
+}
+
 int cmd_flash_erase(int argc, char *argv[])
 {
 	int offset, size;
@@ -2736,7 +2983,8 @@ static int ec_hash_help(const char *cmd)
 }
 
 
-static int ec_hash_print(const struct ec_response_vboot_hash *r)
+static int ec_hash_print(const struct ec_response_vboot_hash_1 *r,
+			 int cmdver)
 {
 	int i;
 
@@ -2764,6 +3012,16 @@ static int ec_hash_print(const struct ec_response_vboot_hash *r)
 	for (i = 0; i < r->digest_size; i++)
 		printf("%02x", r->hash_digest[i]);
 	printf("\n");
+
+	if (cmdver >= 1) {
+		printf("hashed:  0x%08x bytes in %d us", r->hashed_size,
+		       r->hash_time_us);
+		if (r->hash_time_us)
+			printf(" (%d KB/s)",
+			       (int)(r->hashed_size * 1000ULL /
+				     r->hash_time_us));
+		printf("\n");
+	}
 	return 0;
 }
 
@@ -2771,26 +3029,34 @@ static int ec_hash_print(const struct ec_response_vboot_hash *r)
 int cmd_ec_hash(int argc, char *argv[])
 {
 	struct ec_params_vboot_hash p;
-	struct ec_response_vboot_hash r;
+	struct ec_response_vboot_hash_1 r;
+	int cmdver = 1;
+	int rsize = sizeof(r);
 	char *e;
 	int rv;
 
+	if (!ec_cmd_version_supported(EC_CMD_VBOOT_HASH, cmdver)) {
+		/* Fall back to version 0 command */
+		cmdver = 0;
+		rsize = sizeof(struct ec_response_vboot_hash);
+	}
+
 	if (argc < 2) {
 		/* Get hash status */
 		p.cmd = EC_VBOOT_HASH_GET;
-		rv = ec_command(EC_CMD_VBOOT_HASH, 0,
-				&p, sizeof(p), &r, sizeof(r));
+		rv = ec_command(EC_CMD_VBOOT_HASH, cmdver,
+				&p, sizeof(p), &r, rsize);
 		if (rv < 0)
 			return rv;
 
-		return ec_hash_print(&r);
+		return ec_hash_print(&r, cmdver);
 	}
 
 	if (argc == 2 && !strcasecmp(argv[1], "abort")) {
 		/* Abort hash calculation */
 		p.cmd = EC_VBOOT_HASH_ABORT;
-		rv = ec_command(EC_CMD_VBOOT_HASH, 0,
-				&p, sizeof(p), &r, sizeof(r));
+		rv = ec_command(EC_CMD_VBOOT_HASH, cmdver,
+				&p, sizeof(p), &r, rsize);
 		return (rv < 0 ? rv : 0);
 	}
 
@@ -2849,7 +3115,7 @@ int cmd_ec_hash(int argc, char *argv[])
 	} else
 		p.nonce_size = 0;
 
-	rv = ec_command(EC_CMD_VBOOT_HASH, 0, &p, sizeof(p), &r, sizeof(r));
+	rv = ec_command(EC_CMD_VBOOT_HASH, cmdver, &p, sizeof(p), &r, rsize);
 	if (rv < 0)
 		return rv;
 
@@ -2858,7 +3124,7 @@ int cmd_ec_hash(int argc, char *argv[])
 		return 0;
 
 	/* Recalc command does wait around, so a result is ready now */
-	return ec_hash_print(&r);
+	return ec_hash_print(&r, cmdver);
 }
 
 
@@ -2900,11 +3166,93 @@ int cmd_rtc_set(int argc, char *argv[])
 	return 0;
 }
 
+int cmd_chstats(int argc, char *argv[])
+{
+	struct ec_params_console_channel_stats p;
+	struct ec_response_console_channel_stats r;
+	int rv;
+
+	printf(" # Channel         Bytes  Dropped(full)  Dropped(rate)\n");
+	for (p.channel = 0; ; p.channel++) {
+		rv = ec_command(EC_CMD_CONSOLE_CHANNEL_STATS, 0, &p, sizeof(p),
+				&r, sizeof(r));
+		if (rv < 0) {
+			/* Error on the first channel means no support */
+			return p.channel ? 0 : rv;
+		}
+
+		r.name[sizeof(r.name) - 1] = '\0';
+		printf("%2d %-10s %10u     %10u     %10u\n", p.channel,
+		       r.name, r.bytes, r.dropped_full, r.dropped_rate);
+	}
+}
+
+/**
+ * Print console output by sequence number.
+ *
+ * @param seq		Sequence number to start at; updated to the sequence
+ *			number for the next read.
+ * @param report_lost	If non-zero, warn when some output was overwritten.
+ * @return 0 if success, <0 if error.
+ */
+static int console_read_seq(uint32_t *seq, int report_lost)
+{
+	struct ec_params_console_read_v1 p;
+	struct ec_response_console_read_v1 *r = ec_inbuf;
+	int rv;
+
+	while (1) {
+		p.seq = *seq;
+		rv = ec_command(EC_CMD_CONSOLE_READ, 1, &p, sizeof(p),
+				ec_inbuf, ec_max_insize);
+		if (rv < 0)
+			return rv;
+		if (rv < sizeof(*r))
+			return -1;
+
+		if (report_lost && r->seq != p.seq)
+			fprintf(stderr, "Some console output was lost\n");
+		report_lost = 0;
+
+		/* Stop when there are no more whole lines */
+		if (r->next_seq == p.seq)
+			return 0;
+
+		/* Make sure output is null-terminated, then dump it */
+		((char *)ec_inbuf)[ec_max_insize - 1] = '\0';
+		fputs(r->data, stdout);
+		*seq = r->next_seq;
+	}
+}
+
 int cmd_console(int argc, char *argv[])
 {
 	char *out = (char *)ec_inbuf;
+	uint32_t seq = 0;
+	char *e;
 	int rv;
 
+	if (argc > 1) {
+		seq = strtoul(argv[1], &e, 0);
+		if (e && *e) {
+			fprintf(stderr, "Bad sequence number.\n");
+			return -1;
+		}
+	}
+
+	/* Read by sequence number if the EC supports it */
+	if (ec_cmd_version_supported(EC_CMD_CONSOLE_READ, 1)) {
+		rv = console_read_seq(&seq, argc > 1);
+		if (rv < 0)
+			return rv;
+		if (argc > 1)
+			fprintf(stderr, "Next sequence number: %u\n", seq);
+		return 0;
+	} else if (argc > 1) {
+		fprintf(stderr, "EC does not support sequence numbers.\n");
+		return -1;
+	}
+
 	/* Snapshot the EC console */
 	rv = ec_command(EC_CMD_CONSOLE_SNAPSHOT, 0, NULL, 0, NULL, 0);
 	if (rv < 0)
@@ -3173,10 +3521,12 @@ const struct command commands[] = {
 	{"backlight", cmd_lcd_backlight},
 	{"battery", cmd_battery},
 	{"batterycutoff", cmd_battery_cut_off},
+	{"batch", cmd_batch},
 	{"chargecurrentlimit", cmd_charge_current_limit},
 	{"chargedump", cmd_charge_dump},
 	{"chargecontrol", cmd_charge_control},
 	{"chipinfo", cmd_chipinfo},
+	{"chstats", cmd_chstats},
 	{"cmdversions", cmd_cmdversions},
 	{"console", cmd_console},
 	{"echash", cmd_ec_hash},
@@ -3194,10 +3544,12 @@ const struct command commands[] = {
 	{"flasherase", cmd_flash_erase},
 	{"flashprotect", cmd_flash_protect},
 	{"flashread", cmd_flash_read},
+	{"flashupdate", cmd_flash_update},
 	{"flashwrite", cmd_flash_write},
 	{"flashinfo", cmd_flash_info},
 	{"gpioget", cmd_gpio_get},
 	{"gpioset", cmd_gpio_set},
+	{"hcstats", cmd_hcstats},
 	{"hello", cmd_hello},
 	{"kbpress", cmd_kbpress},
 	{"i2cread", cmd_i2c_read},